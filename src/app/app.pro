@@ -75,6 +75,7 @@ FORMS += $$PWD/settingspage.ui
 HEADERS += $$PWD/chatpage.h
 HEADERS += $$PWD/connectpage.h
 HEADERS += $$PWD/helppopup.h
+HEADERS += $$PWD/historyloader.h
 HEADERS += $$PWD/mainwindow.h
 HEADERS += $$PWD/pluginloader.h
 HEADERS += $$PWD/scrollbarstyle.h
@@ -85,6 +86,7 @@ HEADERS += $$PWD/overlay.h
 SOURCES += $$PWD/chatpage.cpp
 SOURCES += $$PWD/connectpage.cpp
 SOURCES += $$PWD/helppopup.cpp
+SOURCES += $$PWD/historyloader.cpp
 SOURCES += $$PWD/main.cpp
 SOURCES += $$PWD/mainwindow.cpp
 SOURCES += $$PWD/pluginloader.cpp
@@ -41,6 +41,8 @@
 #include "titlebar.h"
 #include "overlay.h"
 #include "finder.h"
+#include "historyloader.h"
+#include "logarchive.h"
 #include "mainwindow.h"
 #include "scrollbarstyle.h"
 #include "messagehandler.h"
@@ -51,15 +53,19 @@
 #include <QFontDatabase>
 #include <QStringList>
 #include <QScrollBar>
+#include <IrcNetwork>
 #include <IrcChannel>
 #include <IrcBuffer>
 #include <QSettings>
+#include <QDir>
 #include <Irc>
 
 ChatPage::ChatPage(QWidget* parent) : QSplitter(parent)
 {
     d.currentBuffer = 0;
+    d.scrollback = 1000;
     d.finder = new Finder(this);
+    d.history = new HistoryLoader(this);
     d.splitView = new SplitView(this);
     d.treeWidget = new TreeWidget(this);
     addWidget(d.treeWidget);
@@ -109,6 +115,11 @@ IrcBuffer* ChatPage::currentBuffer() const
     return d.treeWidget->currentBuffer();
 }
 
+QList<TextDocument*> ChatPage::documents() const
+{
+    return d.documents.toList();
+}
+
 QString ChatPage::theme() const
 {
     return d.theme.name();
@@ -125,7 +136,7 @@ void ChatPage::setTheme(const QString& theme)
             QFontDatabase::addApplicationFont(QDir(d.theme.path()).filePath(font));
 
         foreach (TextDocument* doc, d.documents)
-            setupDocument(doc);
+            doc->setStyleSheet(d.theme.style());
         foreach (BufferView* view, d.splitView->views())
             view->titleBar()->setStyleSheet(d.theme.style());
         window()->setStyleSheet(d.theme.style());
@@ -141,6 +152,7 @@ QByteArray ChatPage::saveSettings() const
     QVariantMap settings;
     settings.insert("theme", d.theme.name());
     settings.insert("timestamp", d.timestamp);
+    settings.insert("scrollback", d.scrollback);
     settings.insert("tree", d.treeWidget->saveState());
 
     QByteArray data;
@@ -159,6 +171,7 @@ void ChatPage::restoreSettings(const QByteArray& data)
         d.treeWidget->restoreState(settings.value("tree").toByteArray());
 
     d.timestamp = settings.value("timestamp", "[hh:mm:ss]").toString();
+    d.scrollback = settings.value("scrollback", 1000).toInt();
     setTheme(settings.value("theme", "Cute").toString());
 }
 
@@ -274,6 +287,14 @@ bool ChatPage::commandFilter(IrcCommand* command)
                     foreach (TextDocument* doc, d.documents)
                         doc->setTimeStampFormat(value);
                 }
+            } else if (!key.compare("scrollback", Qt::CaseInsensitive)) {
+                bool ok = false;
+                const int lines = value.toInt(&ok);
+                if (ok && lines > 0 && d.scrollback != lines) {
+                    d.scrollback = lines;
+                    foreach (TextDocument* doc, d.documents)
+                        doc->setMaximumLineCount(lines);
+                }
             } else if (!key.compare("font")) {
                 QFont f = d.splitView->currentView()->textBrowser()->font();
                 if (value.isEmpty())
@@ -367,6 +388,15 @@ void ChatPage::addBuffer(IrcBuffer* buffer)
     setupDocument(doc);
     PluginLoader::instance()->documentAdded(doc);
 
+    // the tail of the local log stands in for the scrollback of the last session,
+    // as long as the logger is there to keep writing it
+    QSettings settings;
+    const int preload = settings.value("loggingPreload", 100).toInt();
+    if (preload > 0 && settings.value("loggingEnabled", false).toBool() && !buffer->network()->name().isEmpty()) {
+        QDir dir(settings.value("loggingLocation").toString());
+        d.history->load(doc, dir.filePath(LogArchive::logFileName(buffer)), preload, settings.value("loggingStructured", false).toBool());
+    }
+
     connect(buffer, SIGNAL(destroyed(IrcBuffer*)), this, SLOT(removeBuffer(IrcBuffer*)));
 
     if (buffer->isChannel() && d.chans.contains(buffer->title())) {
@@ -397,6 +427,7 @@ void ChatPage::setupDocument(TextDocument* document)
     d.documents.insert(document);
 
     document->setTimeStampFormat(d.timestamp);
+    document->setMaximumLineCount(d.scrollback);
     document->setStyleSheet(d.theme.style());
 
     connect(document, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(onMessageReceived(IrcMessage*)));
@@ -509,8 +540,10 @@ void ChatPage::onSocketError()
             if (buffer) {
                 QStringList params = QStringList() << connection->nickName() << connection->socket()->errorString();
                 IrcMessage* message = IrcMessage::fromParameters(buffer->title(), QString::number(Irc::ERR_UNKNOWNERROR), params, connection);
-                foreach (TextDocument* doc, buffer->findChildren<TextDocument*>())
-                    doc->receiveMessage(message);
+                foreach (TextDocument* doc, buffer->findChildren<TextDocument*>()) {
+                    if (!doc->isClone())
+                        doc->receiveMessage(message);
+                }
                 delete message;
 
                 TreeItem* item = d.treeWidget->connectionItem(connection);
@@ -531,8 +564,10 @@ void ChatPage::onSecureError()
             if (buffer) {
                 QStringList params = QStringList() << connection->nickName() << tr("Unable to establish secure connection.");
                 IrcMessage* message = IrcMessage::fromParameters(buffer->title(), QString::number(Irc::ERR_UNKNOWNERROR), params, connection);
-                foreach (TextDocument* doc, buffer->findChildren<TextDocument*>())
-                    doc->receiveMessage(message);
+                foreach (TextDocument* doc, buffer->findChildren<TextDocument*>()) {
+                    if (!doc->isClone())
+                        doc->receiveMessage(message);
+                }
                 delete message;
             }
         }
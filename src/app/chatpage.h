@@ -40,6 +40,7 @@ class Finder;
 class IrcBuffer;
 class SplitView;
 class TreeWidget;
+class HistoryLoader;
 class BufferView;
 class TextDocument;
 class IrcConnection;
@@ -63,6 +64,8 @@ public:
     BufferView* currentView() const;
     IrcBuffer* currentBuffer() const;
 
+    QList<TextDocument*> documents() const;
+
     QByteArray saveSettings() const;
     void restoreSettings(const QByteArray& data);
 
@@ -105,7 +108,9 @@ private:
         Finder* finder;
         ThemeInfo theme;
         QString timestamp;
+        int scrollback;
         QStringList chans;
+        HistoryLoader* history;
         SplitView* splitView;
         TreeWidget* treeWidget;
         QVariantMap timestamps;
@@ -30,16 +30,34 @@
 #include "textdocument.h"
 #include <QWidgetAction>
 #include <QActionGroup>
+#include <QScrollBar>
 #include <QTextBlock>
 #include <QDebug>
+#include <QTimer>
 #include <QMenu>
 
+// how long typing has to pause before a search runs
+static const int debounceDelay = 150;
+
 BrowserFinder::BrowserFinder(TextBrowser* browser) : AbstractFinder(browser)
 {
+    d.forward = false;
+    d.backward = false;
+    d.searching = false;
+    d.exhausted = false;
     d.textBrowser = browser;
     connect(browser, SIGNAL(documentChanged(TextDocument*)), this, SLOT(deleteLater()));
     connect(this, SIGNAL(returnPressed()), this, SLOT(findNext()));
 
+    // typing restarts the timer, which drops the search that was pending
+    d.timer = new QTimer(this);
+    d.timer->setSingleShot(true);
+    d.timer->setInterval(debounceDelay);
+    connect(d.timer, SIGNAL(timeout()), this, SLOT(search()));
+
+    // only the matches in view are highlighted, and again as the view moves
+    connect(browser->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(highlight()));
+
     QMenu *menu = new QMenu(this);
     QAction *search = menu->addAction(tr("Search"));
     search->setCheckable(true);
@@ -69,6 +87,8 @@ BrowserFinder::~BrowserFinder()
 void BrowserFinder::setVisible(bool visible)
 {
     AbstractFinder::setVisible(visible);
+    if (!visible)
+        d.timer->stop();
     if (!visible && d.textBrowser) {
         QTextCursor cursor = d.textBrowser->textCursor();
         if (cursor.hasSelection()) {
@@ -77,120 +97,193 @@ void BrowserFinder::setVisible(bool visible)
         }
         d.textBrowser->setExtraSelections(QList<QTextEdit::ExtraSelection>());
 
-        QTextDocument* doc = d.textBrowser->document();
-        for (QTextBlock block = doc->begin(); block != doc->end(); block = block.next()) {
-            if (!block.isVisible()) {
-                block.setVisible(true);
-                doc->markContentsDirty(block.position(), block.length());
-            }
-        }
+        TextDocument* doc = d.textBrowser->document();
+        if (doc && !doc->filter().isEmpty())
+            doc->applyFilter(QString());
     }
 }
 
 void BrowserFinder::find(const QString& text, bool forward, bool backward, bool typed)
+{
+    d.text = text;
+    d.forward = forward;
+    d.backward = backward;
+    if (typed) {
+        d.timer->start();
+    } else {
+        d.timer->stop();
+        search();
+    }
+}
+
+void BrowserFinder::search()
 {
     if (!d.textBrowser)
         return;
 
-    QTextDocument* doc = d.textBrowser->document();
+    TextDocument* doc = d.textBrowser->document();
+    if (!doc)
+        return;
+
     QTextCursor cursor = d.textBrowser->textCursor();
 
+    // a search is typed unless it came from the next and previous buttons
+    const bool typed = !d.forward && !d.backward;
+    const bool exhausted = d.exhausted;
+    d.exhausted = false;
     bool error = false;
-    QTextDocument::FindFlags options;
 
     if (cursor.hasSelection())
-        cursor.setPosition(typed ? cursor.selectionEnd() : forward ? cursor.position() : cursor.anchor(), QTextCursor::MoveAnchor);
+        cursor.setPosition(typed ? cursor.selectionEnd() : d.forward ? cursor.position() : cursor.anchor(), QTextCursor::MoveAnchor);
 
     QTextCursor newCursor = cursor;
-    QList<QTextEdit::ExtraSelection> extraSelections;
-
-    if (!text.isEmpty()) {
-        if (typed || backward)
-            options |= QTextDocument::FindBackward;
 
-        newCursor = doc->find(text, cursor, options);
+    if (!d.text.isEmpty()) {
+        const bool backward = typed || d.backward;
+        const QList<int> blocks = doc->search(d.text);
 
+        newCursor = locate(blocks, cursor, backward);
+        if (newCursor.isNull() && backward && !exhausted) {
+            // older lines are looked up before wrapping around, and once
+            // the match is laid out the search runs again from here
+            connect(doc, SIGNAL(linesFetched(int)), this, SLOT(older(int)), Qt::ConnectionType(Qt::QueuedConnection | Qt::UniqueConnection));
+            if (doc->findOlder(d.text)) {
+                d.searching = true;
+                return;
+            }
+        }
         if (newCursor.isNull()) {
             QTextCursor ac(doc);
-            ac.movePosition(options & QTextDocument::FindBackward
-                            ? QTextCursor::End : QTextCursor::Start);
-            newCursor = doc->find(text, ac, options);
+            ac.movePosition(backward ? QTextCursor::End : QTextCursor::Start);
+            newCursor = locate(blocks, ac, backward);
             if (newCursor.isNull()) {
                 error = true;
                 newCursor = cursor;
             }
         }
-
-        QTextCursor findCursor(doc);
-        while (!(findCursor = doc->find(text, findCursor)).isNull()) {
-            QTextEdit::ExtraSelection extra;
-            extra.format.setBackground(Qt::yellow);
-            extra.cursor = findCursor;
-            extraSelections.append(extra);
-        }
     }
 
     if (!isVisible())
         animateShow();
     d.textBrowser->setTextCursor(newCursor);
-    d.textBrowser->setExtraSelections(extraSelections);
+    highlight();
     setError(error);
 }
 
-void BrowserFinder::filter(const QString& text)
+void BrowserFinder::older(int count)
 {
-    if (!d.textBrowser)
+    if (!d.searching)
         return;
 
-    QTextDocument* doc = d.textBrowser->document();
+    // nothing older matches, so the search wraps around instead
+    d.searching = false;
+    d.exhausted = !count;
+    search();
+}
 
-    bool error = true;
-    QList<QTextEdit::ExtraSelection> extraSelections;
+void BrowserFinder::highlight()
+{
+    if (!d.textBrowser || !isVisible())
+        return;
 
-    if (!text.isEmpty()) {
-        QTextCursor prevCursor(doc);
-        QTextCursor findCursor(doc);
-        while (!(findCursor = doc->find(text, findCursor)).isNull()) {
-            error = false;
-            findCursor.block().setVisible(true);
-            doc->markContentsDirty(findCursor.block().position(), findCursor.block().length());
-            QTextEdit::ExtraSelection extra;
-            extra.format.setBackground(Qt::yellow);
-            extra.cursor = findCursor;
-            extraSelections.append(extra);
-            while (prevCursor.blockNumber() < findCursor.blockNumber()) {
-                QTextBlock block = prevCursor.block();
-                block.setVisible(false);
-                doc->markContentsDirty(block.position(), block.length());
-                if (!prevCursor.movePosition(QTextCursor::NextBlock))
-                    break;
+    QList<QTextEdit::ExtraSelection> extraSelections;
+    if (!d.text.isEmpty()) {
+        const QRect rect = d.textBrowser->viewport()->rect();
+        QTextBlock block = d.textBrowser->cursorForPosition(rect.topLeft()).block();
+        const int last = d.textBrowser->cursorForPosition(rect.bottomRight()).blockNumber();
+        for (; block.isValid() && block.blockNumber() <= last; block = block.next()) {
+            if (!block.isVisible())
+                continue;
+            QString line = block.text();
+            line.replace(QChar::Nbsp, QLatin1Char(' '));
+            int index = line.indexOf(d.text, 0, Qt::CaseInsensitive);
+            while (index != -1) {
+                QTextEdit::ExtraSelection extra;
+                extra.format.setBackground(Qt::yellow);
+                extra.cursor = QTextCursor(block);
+                extra.cursor.setPosition(block.position() + index);
+                extra.cursor.setPosition(block.position() + index + d.text.length(), QTextCursor::KeepAnchor);
+                extraSelections.append(extra);
+                index = line.indexOf(d.text, index + d.text.length(), Qt::CaseInsensitive);
             }
-            prevCursor = findCursor;
-            prevCursor.movePosition(QTextCursor::NextBlock);
         }
-        while (!prevCursor.atEnd()) {
-            QTextBlock block = prevCursor.block();
-            if (block.isVisible()) {
-                block.setVisible(false);
-                doc->markContentsDirty(block.position(), block.length());
+    }
+    d.textBrowser->setExtraSelections(extraSelections);
+}
+
+QTextCursor BrowserFinder::locate(const QList<int>& blocks, const QTextCursor& from, bool backward)
+{
+    // the same rules as QTextDocument::find(), within the matching blocks only
+    const int position = from.position();
+    const int number = from.blockNumber();
+
+    if (backward) {
+        QList<int>::const_iterator it = qUpperBound(blocks.constBegin(), blocks.constEnd(), number);
+        while (it != blocks.constBegin()) {
+            --it;
+            const QTextBlock block = reveal(*it);
+            QString line = block.text();
+            line.replace(QChar::Nbsp, QLatin1Char(' '));
+            int offset = -1;
+            if (*it == number)
+                offset = position - block.position() - 1;
+            if (*it != number || offset >= 0) {
+                const int index = line.lastIndexOf(d.text, offset, Qt::CaseInsensitive);
+                if (index != -1) {
+                    QTextCursor cursor(block);
+                    cursor.setPosition(block.position() + index);
+                    cursor.setPosition(block.position() + index + d.text.length(), QTextCursor::KeepAnchor);
+                    return cursor;
+                }
             }
-            if (!prevCursor.movePosition(QTextCursor::NextBlock))
-                break;
         }
     } else {
-        error = false;
-        for (QTextBlock block = doc->begin(); block != doc->end(); block = block.next()) {
-            if (!block.isVisible()) {
-                block.setVisible(true);
-                doc->markContentsDirty(block.position(), block.length());
+        QList<int>::const_iterator it = qLowerBound(blocks.constBegin(), blocks.constEnd(), number);
+        for (; it != blocks.constEnd(); ++it) {
+            const QTextBlock block = reveal(*it);
+            QString line = block.text();
+            line.replace(QChar::Nbsp, QLatin1Char(' '));
+            const int offset = *it == number ? position - block.position() : 0;
+            const int index = line.indexOf(d.text, offset, Qt::CaseInsensitive);
+            if (index != -1) {
+                QTextCursor cursor(block);
+                cursor.setPosition(block.position() + index);
+                cursor.setPosition(block.position() + index + d.text.length(), QTextCursor::KeepAnchor);
+                return cursor;
             }
         }
     }
+    return QTextCursor();
+}
+
+QTextBlock BrowserFinder::reveal(int number)
+{
+    // a reply that only matches within is expanded, so that the match can be shown
+    TextDocument* doc = d.textBrowser->document();
+    QString line = doc->findBlockByNumber(number).text();
+    line.replace(QChar::Nbsp, QLatin1Char(' '));
+    if (!line.contains(d.text, Qt::CaseInsensitive))
+        doc->expand(number);
+    return doc->findBlockByNumber(number);
+}
+
+void BrowserFinder::filter(const QString& text)
+{
+    if (!d.textBrowser)
+        return;
+
+    TextDocument* doc = d.textBrowser->document();
+    if (!doc)
+        return;
+
+    d.timer->stop();
+    const int count = doc->applyFilter(text);
+    d.text = doc->filter().text();
 
     if (!isVisible())
         animateShow();
-    d.textBrowser->setExtraSelections(extraSelections);
-    setError(error);
+    highlight();
+    setError(!text.isEmpty() && !count);
 }
 
 void BrowserFinder::relocate()
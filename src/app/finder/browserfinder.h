@@ -30,7 +30,10 @@
 #define BROWSERFINDER_H
 
 #include "abstractfinder.h"
+#include <QTextBlock>
+#include <QTextCursor>
 
+class QTimer;
 class TextBrowser;
 
 class BrowserFinder : public AbstractFinder
@@ -48,8 +51,22 @@ protected slots:
     void filter(const QString &text);
     void relocate();
 
+private slots:
+    void search();
+    void older(int count);
+    void highlight();
+
 private:
+    QTextCursor locate(const QList<int>& blocks, const QTextCursor& from, bool backward);
+    QTextBlock reveal(int number);
+
     struct Private {
+        bool forward;
+        bool backward;
+        bool searching;
+        bool exhausted;
+        QString text;
+        QTimer* timer;
         TextBrowser* textBrowser;
         QToolButton* menuButton;
     } d;
@@ -30,11 +30,13 @@
 #include "chatpage.h"
 #include "browserfinder.h"
 #include "textbrowser.h"
+#include "textdocument.h"
 #include "treewidget.h"
 #include "treefinder.h"
 #include "listfinder.h"
 #include "bufferview.h"
 #include "textinput.h"
+#include "searchpane.h"
 #include "listview.h"
 #include <QApplication>
 #include <QTimer>
@@ -45,6 +47,7 @@ Finder::Finder(ChatPage* page) : QObject(page)
     d.browserFilter = false;
     d.nextShortcut = 0;
     d.prevShortcut = 0;
+    d.searchPane = 0;
     d.lastSearch = NoSearch;
 
     QShortcut* shortcut = new QShortcut(QKeySequence::Find, page);
@@ -56,6 +59,9 @@ Finder::Finder(ChatPage* page) : QObject(page)
     shortcut = new QShortcut(QKeySequence("Ctrl+U"), page);
     connect(shortcut, SIGNAL(activated()), this, SLOT(searchList()));
 
+    shortcut = new QShortcut(QKeySequence("Ctrl+Shift+F"), page);
+    connect(shortcut, SIGNAL(activated()), this, SLOT(searchGlobal()));
+
     d.cancelShortcut = new QShortcut(Qt::Key_Escape, page);
     d.cancelShortcut->setEnabled(false);
     connect(d.cancelShortcut, SIGNAL(activated()), this, SLOT(cancelTreeSearch()));
@@ -112,6 +118,15 @@ void Finder::searchBrowser(BufferView* view)
     }
 }
 
+void Finder::searchGlobal()
+{
+    if (!d.searchPane) {
+        d.searchPane = new SearchPane(d.page);
+        connect(d.searchPane, SIGNAL(activated(TextDocument*,QString)), this, SLOT(showResult(TextDocument*,QString)));
+    }
+    d.searchPane->popup();
+}
+
 void Finder::findAgain()
 {
     switch (d.lastSearch) {
@@ -210,3 +225,21 @@ void Finder::finderDestroyed(AbstractFinder* input)
     d.finders.remove(input);
     d.cancelShortcut->setEnabled(!d.finders.isEmpty());
 }
+
+void Finder::showResult(TextDocument* document, const QString& text)
+{
+    d.page->treeWidget()->setCurrentBuffer(document->buffer());
+    d.page->window()->activateWindow();
+
+    BufferView* view = d.page->currentView();
+    if (view) {
+        d.browserSearch = text;
+        AbstractFinder* finder = view->textBrowser()->findChild<BrowserFinder*>();
+        if (finder) {
+            finder->setText(text);
+            finder->doFind();
+        } else {
+            searchBrowser(view);
+        }
+    }
+}
@@ -35,7 +35,9 @@
 #include <QShortcut>
 
 class ChatPage;
+class SearchPane;
 class BufferView;
+class TextDocument;
 class AbstractFinder;
 
 class Finder : public QObject
@@ -55,12 +57,15 @@ public slots:
     void searchBrowser(BufferView* view = 0);
     void cancelBrowserSearch(BufferView* view = 0);
 
+    void searchGlobal();
+
 private slots:
     void findAgain();
     void findNext();
     void findPrevious();
     void startSearch(AbstractFinder* input, const QString& text, bool filter = false);
     void finderDestroyed(AbstractFinder* input);
+    void showResult(TextDocument* document, const QString& text);
 
 private:
     enum SearchMode { NoSearch, TreeSearch, ListSearch, BrowserSearch };
@@ -77,6 +82,7 @@ private:
         QShortcut* cancelShortcut;
         SearchMode lastSearch;
         QPointer<AbstractFinder> currentFinder;
+        SearchPane* searchPane;
     } d;
 };
 
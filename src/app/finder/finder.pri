@@ -8,11 +8,15 @@ INCLUDEPATH += $$PWD
 HEADERS += $$PWD/abstractfinder.h
 HEADERS += $$PWD/browserfinder.h
 HEADERS += $$PWD/finder.h
+HEADERS += $$PWD/globalsearch.h
 HEADERS += $$PWD/listfinder.h
+HEADERS += $$PWD/searchpane.h
 HEADERS += $$PWD/treefinder.h
 
 SOURCES += $$PWD/abstractfinder.cpp
 SOURCES += $$PWD/browserfinder.cpp
 SOURCES += $$PWD/finder.cpp
+SOURCES += $$PWD/globalsearch.cpp
 SOURCES += $$PWD/listfinder.cpp
+SOURCES += $$PWD/searchpane.cpp
 SOURCES += $$PWD/treefinder.cpp
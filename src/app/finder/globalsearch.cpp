@@ -0,0 +1,344 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "globalsearch.h"
+#include "textdocument.h"
+#include "messagedata.h"
+#include "styledtext.h"
+#include "logarchive.h"
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThreadPool>
+#include <IrcNetwork>
+#include <QRunnable>
+#include <QFileInfo>
+#include <IrcBuffer>
+#include <QTimer>
+#include <QDir>
+
+// documents snapshotted per pass, so hundreds of buffers don't stall the gui
+static const int dispatchCount = 16;
+// hits kept per search, more than that is of no use in the pane
+static const int hitLimit = 2000;
+// lines scanned between checks for cancellation
+static const int checkInterval = 512;
+
+// the logger's line format: "[yyyy-MM-dd] hh:mm:ss nick: content"
+static const QString stampFormat = QStringLiteral("[yyyy-MM-dd] hh:mm:ss");
+static const int stampLength = 21;
+
+// tasks report back by id, so a cancelled or finished search never gets called
+static QMutex mutex;
+static QHash<int, GlobalSearch*> searches;
+static int nextId = 0;
+
+static QString plainText(const QString& html)
+{
+    QString text;
+    QList<StyledText::Run> runs;
+    if (StyledText::parse(html, &runs)) {
+        foreach (const StyledText::Run& run, runs)
+            text += run.text;
+    } else {
+        // unknown markup, drop the tags and keep the rest
+        bool tag = false;
+        foreach (const QChar& c, html) {
+            if (c == QLatin1Char('<'))
+                tag = true;
+            else if (c == QLatin1Char('>'))
+                tag = false;
+            else if (!tag)
+                text += c;
+        }
+    }
+    text.replace(QChar::Nbsp, QLatin1Char(' '));
+    return text;
+}
+
+class SearchTask : public QRunnable
+{
+public:
+    SearchTask(int search, const QString& text) : search(search), text(text) { }
+
+    void run()
+    {
+        QList<SearchHit> hits;
+        if (!isCancelled())
+            collect(&hits);
+
+        QMutexLocker locker(&mutex);
+        if (GlobalSearch* target = searches.value(search))
+            QMetaObject::invokeMethod(target, "complete", Qt::QueuedConnection, Q_ARG(int, search), Q_ARG(QList<SearchHit>, hits));
+    }
+
+protected:
+    virtual void collect(QList<SearchHit>* hits) = 0;
+
+    bool isCancelled() const
+    {
+        QMutexLocker locker(&mutex);
+        return !searches.contains(search);
+    }
+
+    bool matches(const QString& line) const
+    {
+        return line.contains(text, Qt::CaseInsensitive);
+    }
+
+private:
+    int search;
+    QString text;
+};
+
+class DocumentTask : public SearchTask
+{
+public:
+    DocumentTask(int search, const QString& text, int source, const QString& title, const QList<MessageData>& lines)
+        : SearchTask(search, text), source(source), title(title), lines(lines) { }
+
+protected:
+    void collect(QList<SearchHit>* hits)
+    {
+        for (int i = 0; i < lines.count() && hits->count() < hitLimit; ++i) {
+            if (i % checkInterval == 0 && isCancelled())
+                return;
+            const MessageData& line = lines.at(i);
+            QString text = plainText(line.format());
+            if (!matches(text)) {
+                // collapsed replies are found by what they hold
+                foreach (const QString& field, line.fields()) {
+                    if (matches(field)) {
+                        text += QLatin1Char(' ') + field;
+                        break;
+                    }
+                }
+            }
+            if (matches(text)) {
+                SearchHit hit;
+                hit.source = source;
+                hit.title = title;
+                hit.text = text;
+                hit.timestamp = line.timestamp();
+                hits->append(hit);
+            }
+        }
+    }
+
+private:
+    int source;
+    QString title;
+    QList<MessageData> lines;
+};
+
+class LogTask : public SearchTask
+{
+public:
+    LogTask(int search, const QString& text, const QString& filePath, const QDateTime& until)
+        : SearchTask(search, text), filePath(filePath), until(until) { }
+
+protected:
+    void collect(QList<SearchHit>* hits)
+    {
+        // rotated segments are decompressed a frame at a time
+        LogArchive file(filePath);
+        if (!file.open(QIODevice::ReadOnly))
+            return;
+
+        const QString title = QFileInfo(LogArchive::activeName(QFileInfo(filePath).fileName())).completeBaseName();
+        QTextStream stream(&file);
+        for (int i = 0; !stream.atEnd() && hits->count() < hitLimit; ++i) {
+            if (i % checkInterval == 0 && isCancelled())
+                return;
+            const QString line = stream.readLine();
+            if (line.length() <= stampLength || !matches(line.mid(stampLength + 1)))
+                continue;
+            // headers don't parse, and neither do lines of other formats
+            const QDateTime timestamp = QDateTime::fromString(line.left(stampLength), stampFormat);
+            if (!timestamp.isValid() || (until.isValid() && timestamp >= until))
+                continue;
+            SearchHit hit;
+            hit.title = title;
+            hit.text = line.mid(stampLength + 1);
+            hit.timestamp = timestamp;
+            hits->append(hit);
+        }
+    }
+
+private:
+    QString filePath;
+    QDateTime until;
+};
+
+GlobalSearch::GlobalSearch(QObject* parent) : QObject(parent)
+{
+    qRegisterMetaType<QList<SearchHit> >();
+
+    d.id = -1;
+    d.next = 0;
+    d.done = 0;
+    d.total = 0;
+    d.hits = 0;
+
+    d.timer = new QTimer(this);
+    d.timer->setInterval(0);
+    connect(d.timer, SIGNAL(timeout()), this, SLOT(dispatch()));
+}
+
+GlobalSearch::~GlobalSearch()
+{
+    QMutexLocker locker(&mutex);
+    searches.remove(d.id);
+}
+
+int GlobalSearch::maximumHits()
+{
+    return hitLimit;
+}
+
+QString GlobalSearch::text() const
+{
+    return d.text;
+}
+
+bool GlobalSearch::isActive() const
+{
+    return d.id != -1;
+}
+
+int GlobalSearch::hitCount() const
+{
+    return d.hits;
+}
+
+TextDocument* GlobalSearch::document(int source) const
+{
+    return d.documents.value(source);
+}
+
+void GlobalSearch::start(const QString& text, const QList<TextDocument*>& documents, const QString& logDir)
+{
+    cancel();
+
+    d.text = text;
+    d.next = 0;
+    d.done = 0;
+    d.hits = 0;
+    d.logs.clear();
+    d.covered.clear();
+    d.documents.clear();
+    if (text.isEmpty())
+        return;
+
+    foreach (TextDocument* doc, documents) {
+        if (!doc->isClone())
+            d.documents += doc;
+    }
+    if (!logDir.isEmpty()) {
+        QDir dir(logDir);
+        foreach (const QString& name, dir.entryList(QStringList() << "*.log" << "*.log" + LogArchive::suffix(), QDir::Files))
+            d.logs += dir.filePath(name);
+    }
+    d.total = d.documents.count() + d.logs.count();
+
+    {
+        QMutexLocker locker(&mutex);
+        d.id = nextId++;
+        searches.insert(d.id, this);
+    }
+
+    emit started();
+    emit progress(0, d.total);
+    if (d.total == 0)
+        finish();
+    else
+        d.timer->start();
+}
+
+void GlobalSearch::cancel()
+{
+    if (isActive())
+        finish();
+}
+
+void GlobalSearch::dispatch()
+{
+    QThreadPool* pool = QThreadPool::globalInstance();
+
+    const int end = qMin(d.next + dispatchCount, d.documents.count());
+    for (; d.next < end; ++d.next) {
+        TextDocument* doc = d.documents.at(d.next);
+        QString title;
+        QList<MessageData> lines;
+        if (doc) {
+            IrcBuffer* buffer = doc->buffer();
+            title = buffer->title();
+            lines = doc->lines();
+            if (!lines.isEmpty()) {
+                // the log only has to cover what is no longer in the document,
+                // and its timestamps are to the second
+                QDateTime oldest = lines.first().timestamp();
+                oldest.setTime(QTime(oldest.time().hour(), oldest.time().minute(), oldest.time().second()));
+                d.covered.insert(LogArchive::logFileName(buffer), oldest);
+            }
+        }
+        pool->start(new DocumentTask(d.id, d.text, d.next, title, lines));
+    }
+
+    if (d.next >= d.documents.count()) {
+        d.timer->stop();
+        foreach (const QString& log, d.logs)
+            pool->start(new LogTask(d.id, d.text, log, d.covered.value(LogArchive::activeName(QFileInfo(log).fileName()))));
+    }
+}
+
+void GlobalSearch::complete(int search, const QList<SearchHit>& hits)
+{
+    if (search != d.id)
+        return;
+
+    ++d.done;
+    const QList<SearchHit> batch = hits.mid(0, hitLimit - d.hits);
+    d.hits += batch.count();
+    if (!batch.isEmpty())
+        emit found(batch);
+    emit progress(d.done, d.total);
+
+    if (d.done >= d.total || d.hits >= hitLimit)
+        finish();
+}
+
+void GlobalSearch::finish()
+{
+    {
+        QMutexLocker locker(&mutex);
+        searches.remove(d.id);
+    }
+    d.id = -1;
+    d.timer->stop();
+    emit finished();
+}
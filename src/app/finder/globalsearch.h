@@ -0,0 +1,104 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GLOBALSEARCH_H
+#define GLOBALSEARCH_H
+
+#include <QStringList>
+#include <QDateTime>
+#include <QMetaType>
+#include <QPointer>
+#include <QObject>
+#include <QHash>
+#include <QList>
+
+class QTimer;
+class TextDocument;
+
+struct SearchHit
+{
+    SearchHit() : source(-1) { }
+
+    int source;
+    QString title;
+    QString text;
+    QDateTime timestamp;
+};
+
+Q_DECLARE_METATYPE(SearchHit)
+Q_DECLARE_METATYPE(QList<SearchHit>)
+
+class GlobalSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit GlobalSearch(QObject* parent = 0);
+    ~GlobalSearch();
+
+    static int maximumHits();
+
+    QString text() const;
+    bool isActive() const;
+    int hitCount() const;
+
+    TextDocument* document(int source) const;
+
+public slots:
+    void start(const QString& text, const QList<TextDocument*>& documents, const QString& logDir = QString());
+    void cancel();
+
+signals:
+    void started();
+    void found(const QList<SearchHit>& hits);
+    void progress(int value, int maximum);
+    void finished();
+
+private slots:
+    void dispatch();
+    void complete(int search, const QList<SearchHit>& hits);
+
+private:
+    void finish();
+
+    struct Private {
+        int id;
+        int next;
+        int done;
+        int total;
+        int hits;
+        QString text;
+        QString logDir;
+        QStringList logs;
+        QTimer* timer;
+        QList<QPointer<TextDocument> > documents;
+        QHash<QString, QDateTime> covered;
+    } d;
+};
+
+#endif // GLOBALSEARCH_H
@@ -28,12 +28,36 @@
 
 #include "listfinder.h"
 #include "listview.h"
+#include "nickindex.h"
+#include <IrcUserModel>
+#include <QtAlgorithms>
+#include <IrcChannel>
 #include <Irc>
 
 ListFinder::ListFinder(ListView* list) : AbstractFinder(list)
 {
     d.list = list;
+    d.rowsValid = 0;
     connect(this, SIGNAL(returnPressed()), this, SLOT(onReturnPressed()));
+
+    // rows are looked up from the channel's shared nick index, and mapped
+    // to the view through a table that follows the model's joins and parts
+    // and is only renumbered from the first row that changed
+    QAbstractItemModel* model = list->model();
+    connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(onRowsInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(onRowsRemoved(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(onRowsMoved(QModelIndex,int,int,QModelIndex,int)));
+    connect(model, SIGNAL(layoutChanged()), this, SLOT(invalidateRows()));
+    connect(model, SIGNAL(modelReset()), this, SLOT(invalidateRows()));
+
+    connect(list, SIGNAL(channelChanged(IrcChannel*)), this, SLOT(onChannelChanged(IrcChannel*)));
+    onChannelChanged(list->channel());
+}
+
+ListFinder::~ListFinder()
+{
+    if (d.nicks)
+        d.nicks->release();
 }
 
 void ListFinder::find(const QString& text, bool forward, bool backward, bool typed)
@@ -44,41 +68,67 @@ void ListFinder::find(const QString& text, bool forward, bool backward, bool typ
 
     QAbstractItemModel* model = d.list->model();
     if (typed) {
-        QList<QModelIndex> indexes = model->match(model->index(0, 0), Irc::NameRole, text, -1, Qt::MatchExactly | Qt::MatchWrap);
-        if (indexes.isEmpty())
-            indexes = model->match(model->index(0, 0), Irc::NameRole, text, -1, Qt::MatchContains | Qt::MatchWrap);
-        if (!indexes.isEmpty() && !indexes.contains(d.list->currentIndex()))
-            d.list->setCurrentIndex(indexes.first());
-        setError(indexes.isEmpty());
+        QList<int> rows = matches(text, true);
+        if (rows.isEmpty())
+            rows = matches(text, false);
+        if (!rows.isEmpty() && !rows.contains(d.list->currentIndex().row()))
+            d.list->setCurrentIndex(model->index(rows.first(), 0));
+        setError(rows.isEmpty());
     } else {
         QModelIndex index = d.list->currentIndex();
         if (index.isValid()) {
-            if (forward)
-                index = index.sibling(index.row() + 1, index.column());
-            else
-                index = index.sibling(index.row() - 1, index.column());
-            bool wrapped = false;
-            while (index.isValid()) {
-                if (index.data(Irc::NameRole).toString().contains(text, Qt::CaseInsensitive)) {
-                    d.list->setCurrentIndex(index);
-                    return;
-                }
-                if (forward)
-                    index = index.sibling(index.row() + 1, index.column());
-                else
-                    index = index.sibling(index.row() - 1, index.column());
-                if (!index.isValid() && !wrapped) {
-                    if (forward)
-                        index = model->index(0, 0);
-                    else
-                        index = model->index(model->rowCount() - 1, 0);
-                    wrapped = true;
-                }
+            const QList<int> rows = matches(text, false);
+            if (rows.isEmpty())
+                return;
+            int row = -1;
+            if (forward) {
+                QList<int>::const_iterator it = qUpperBound(rows, index.row());
+                row = it != rows.constEnd() ? *it : rows.first();
+            } else {
+                QList<int>::const_iterator it = qLowerBound(rows, index.row());
+                row = it != rows.constBegin() ? *(it - 1) : rows.last();
             }
+            d.list->setCurrentIndex(model->index(row, 0));
         }
     }
 }
 
+QList<int> ListFinder::matches(const QString& text, bool exact) const
+{
+    QList<int> rows;
+    IrcUserModel* model = qobject_cast<IrcUserModel*>(d.list->model());
+    if (!d.nicks || !model)
+        return rows;
+
+    QList<IrcUser*> users;
+    if (exact) {
+        if (IrcUser* user = d.nicks->lookup().find(text))
+            users += user;
+    } else {
+        users = d.nicks->lookup().containing(text);
+    }
+    foreach (IrcUser* user, users) {
+        const int row = rowOf(user);
+        if (row != -1)
+            rows += row;
+    }
+    qSort(rows);
+    return rows;
+}
+
+int ListFinder::rowOf(IrcUser* user) const
+{
+    const int row = d.rows.value(user, -1);
+    if (row != -1 && row < d.rowsValid)
+        return row;
+
+    // renumbered from the first row that changed since the last time
+    for (int i = d.rowsValid; i < d.order.count(); ++i)
+        d.rows.insert(d.order.at(i), i);
+    d.rowsValid = d.order.count();
+    return d.rows.value(user, -1);
+}
+
 void ListFinder::relocate()
 {
     QRect r = rect();
@@ -102,3 +152,69 @@ void ListFinder::onReturnPressed()
         animateHide();
     }
 }
+
+void ListFinder::onChannelChanged(IrcChannel* channel)
+{
+    if (d.nicks)
+        d.nicks->release();
+    d.nicks = NickIndex::acquire(channel);
+    invalidateRows();
+}
+
+void ListFinder::onRowsInserted(const QModelIndex& parent, int first, int last)
+{
+    IrcUserModel* model = qobject_cast<IrcUserModel*>(d.list->model());
+    if (parent.isValid() || !model)
+        return;
+
+    const QList<IrcUser*> users = model->users();
+    if (users.count() != d.order.count() + last - first + 1) {
+        invalidateRows();
+        return;
+    }
+    for (int i = first; i <= last; ++i)
+        d.order.insert(i, users.at(i));
+    d.rowsValid = qMin(d.rowsValid, first);
+}
+
+void ListFinder::onRowsRemoved(const QModelIndex& parent, int first, int last)
+{
+    if (parent.isValid())
+        return;
+
+    if (last >= d.order.count()) {
+        invalidateRows();
+        return;
+    }
+    for (int i = first; i <= last; ++i)
+        d.rows.remove(d.order.takeAt(first));
+    d.rowsValid = qMin(d.rowsValid, first);
+}
+
+void ListFinder::onRowsMoved(const QModelIndex& parent, int first, int last, const QModelIndex& destination, int row)
+{
+    if (parent.isValid() || destination.isValid())
+        return;
+
+    if (last >= d.order.count() || row > d.order.count()) {
+        invalidateRows();
+        return;
+    }
+    // the destination row counts the moved rows when it is below them
+    QList<IrcUser*> moved;
+    for (int i = first; i <= last; ++i)
+        moved += d.order.takeAt(first);
+    if (row > last)
+        row -= moved.count();
+    for (int i = 0; i < moved.count(); ++i)
+        d.order.insert(row + i, moved.at(i));
+    d.rowsValid = qMin(d.rowsValid, qMin(first, row));
+}
+
+void ListFinder::invalidateRows()
+{
+    IrcUserModel* model = qobject_cast<IrcUserModel*>(d.list->model());
+    d.order = model ? model->users() : QList<IrcUser*>();
+    d.rows.clear();
+    d.rowsValid = 0;
+}
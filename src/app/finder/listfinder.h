@@ -30,8 +30,15 @@
 #define LISTFINDER_H
 
 #include "abstractfinder.h"
+#include <QPointer>
+#include <QHash>
+#include <QList>
 
+class IrcUser;
+class QModelIndex;
 class ListView;
+class NickIndex;
+class IrcChannel;
 
 class ListFinder : public AbstractFinder
 {
@@ -39,6 +46,7 @@ class ListFinder : public AbstractFinder
 
 public:
     explicit ListFinder(ListView* list);
+    ~ListFinder();
 
 protected slots:
     void find(const QString& text, bool forward = false, bool backward = false, bool typed = true);
@@ -46,10 +54,22 @@ protected slots:
 
 private slots:
     void onReturnPressed();
+    void onChannelChanged(IrcChannel* channel);
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onRowsRemoved(const QModelIndex& parent, int first, int last);
+    void onRowsMoved(const QModelIndex& parent, int first, int last, const QModelIndex& destination, int row);
+    void invalidateRows();
 
 private:
+    QList<int> matches(const QString& text, bool exact) const;
+    int rowOf(IrcUser* user) const;
+
     struct Private {
         ListView* list;
+        QPointer<NickIndex> nicks;
+        QList<IrcUser*> order;
+        mutable int rowsValid;
+        mutable QHash<IrcUser*, int> rows;
     } d;
 };
 
@@ -0,0 +1,148 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "searchpane.h"
+#include "chatpage.h"
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QHeaderView>
+#include <QShortcut>
+#include <QLineEdit>
+#include <QSettings>
+#include <QLabel>
+
+SearchPane::SearchPane(ChatPage* page) : QWidget(page, Qt::Tool)
+{
+    d.page = page;
+    setWindowTitle(tr("Search All Views"));
+
+    d.lineEdit = new QLineEdit(this);
+    d.lineEdit->setPlaceholderText(tr("Search..."));
+    d.lineEdit->setClearButtonEnabled(true);
+    connect(d.lineEdit, SIGNAL(returnPressed()), this, SLOT(search()));
+
+    d.results = new QTreeWidget(this);
+    d.results->setHeaderLabels(QStringList() << tr("Time") << tr("View") << tr("Message"));
+    d.results->header()->setStretchLastSection(true);
+    d.results->setRootIsDecorated(false);
+    d.results->setUniformRowHeights(true);
+    d.results->setSortingEnabled(true);
+    d.results->sortByColumn(0, Qt::AscendingOrder);
+    connect(d.results, SIGNAL(itemActivated(QTreeWidgetItem*,int)), this, SLOT(activateItem(QTreeWidgetItem*)));
+
+    d.status = new QLabel(this);
+
+    d.search = new GlobalSearch(this);
+    connect(d.search, SIGNAL(found(QList<SearchHit>)), this, SLOT(addHits(QList<SearchHit>)));
+    connect(d.search, SIGNAL(progress(int,int)), this, SLOT(updateProgress(int,int)));
+    connect(d.search, SIGNAL(finished()), this, SLOT(updateCount()));
+
+    QShortcut* shortcut = new QShortcut(Qt::Key_Escape, this);
+    connect(shortcut, SIGNAL(activated()), this, SLOT(cancel()));
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(d.lineEdit);
+    layout->addWidget(d.results);
+    layout->addWidget(d.status);
+
+    resize(640, 400);
+}
+
+QString SearchPane::text() const
+{
+    return d.lineEdit->text();
+}
+
+void SearchPane::popup()
+{
+    show();
+    raise();
+    activateWindow();
+    d.lineEdit->setFocus();
+    d.lineEdit->selectAll();
+}
+
+void SearchPane::search()
+{
+    d.results->clear();
+    d.status->clear();
+
+    QSettings settings;
+    d.search->start(d.lineEdit->text(), d.page->documents(), settings.value("loggingLocation").toString());
+}
+
+void SearchPane::cancel()
+{
+    if (d.search->isActive())
+        d.search->cancel();
+    else
+        hide();
+}
+
+void SearchPane::hideEvent(QHideEvent* event)
+{
+    d.search->cancel();
+    QWidget::hideEvent(event);
+}
+
+void SearchPane::addHits(const QList<SearchHit>& hits)
+{
+    QList<QTreeWidgetItem*> items;
+    foreach (const SearchHit& hit, hits) {
+        QTreeWidgetItem* item = new QTreeWidgetItem(QStringList() << hit.timestamp.toString("yyyy-MM-dd hh:mm:ss") << hit.title << hit.text);
+        item->setData(0, Qt::UserRole, hit.source);
+        item->setToolTip(2, hit.text);
+        items += item;
+    }
+
+    // a sorted view sorts on every insert, sort once per batch instead
+    d.results->setSortingEnabled(false);
+    d.results->addTopLevelItems(items);
+    d.results->setSortingEnabled(true);
+}
+
+void SearchPane::updateProgress(int value, int maximum)
+{
+    d.status->setText(tr("Searching %1/%2...").arg(value).arg(maximum));
+}
+
+void SearchPane::updateCount()
+{
+    const int count = d.results->topLevelItemCount();
+    if (count >= GlobalSearch::maximumHits())
+        d.status->setText(tr("Showing the first %1 matches").arg(count));
+    else
+        d.status->setText(tr("%1 matches").arg(count));
+}
+
+void SearchPane::activateItem(QTreeWidgetItem* item)
+{
+    TextDocument* document = d.search->document(item->data(0, Qt::UserRole).toInt());
+    if (document)
+        emit activated(document, d.search->text());
+}
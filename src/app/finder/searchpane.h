@@ -0,0 +1,78 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SEARCHPANE_H
+#define SEARCHPANE_H
+
+#include <QWidget>
+#include "globalsearch.h"
+
+class QLabel;
+class ChatPage;
+class QLineEdit;
+class QTreeWidget;
+class TextDocument;
+class QTreeWidgetItem;
+
+class SearchPane : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit SearchPane(ChatPage* page);
+
+    QString text() const;
+
+public slots:
+    void popup();
+    void search();
+    void cancel();
+
+signals:
+    void activated(TextDocument* document, const QString& text);
+
+protected:
+    void hideEvent(QHideEvent* event);
+
+private slots:
+    void addHits(const QList<SearchHit>& hits);
+    void updateProgress(int value, int maximum);
+    void updateCount();
+    void activateItem(QTreeWidgetItem* item);
+
+private:
+    struct Private {
+        ChatPage* page;
+        QLabel* status;
+        QLineEdit* lineEdit;
+        QTreeWidget* results;
+        GlobalSearch* search;
+    } d;
+};
+
+#endif // SEARCHPANE_H
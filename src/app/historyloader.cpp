@@ -0,0 +1,267 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "historyloader.h"
+#include "messageformatter.h"
+#include "formatpipeline.h"
+#include "textdocument.h"
+#include "logarchive.h"
+#include "messagelog.h"
+#include <IrcConnection>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QFileInfo>
+#include <QQueue>
+#include <IrcBuffer>
+#include <QFile>
+#include <QDir>
+#include <QSet>
+
+// the logger's line format: "[yyyy-MM-dd] hh:mm:ss nick: content"
+static const QString stampFormat = QStringLiteral("[yyyy-MM-dd] hh:mm:ss");
+static const int stampLength = 21;
+// a guess at the bytes per line, to size the first look at the tail
+static const int lineLength = 128;
+// the widest look at the tail, well within what a mapping can be indexed by
+static const qint64 maximumWindow = 64 * 1024 * 1024;
+
+// tasks report back only to a loader that is still alive
+static QMutex mutex;
+static QSet<HistoryLoader*> loaders;
+
+// the last lines of the file, found by mapping its tail and scanning back
+// for newlines, with the window widened until enough of them are found
+static QStringList tail(const QString& filePath, int count)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QStringList();
+
+    const qint64 size = file.size();
+    const qint64 limit = qMin(size, maximumWindow);
+    qint64 window = qMin(limit, qint64(count + 1) * lineLength);
+    while (window > 0) {
+        uchar* map = file.map(size - window, window);
+        if (!map)
+            return QStringList();
+
+        const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(map), int(window));
+        int start = -1;
+        int newlines = 0;
+        // the last line ends with a newline, so n lines take n + 1 of them
+        for (int i = bytes.lastIndexOf('\n'); i != -1; i = i > 0 ? bytes.lastIndexOf('\n', i - 1) : -1) {
+            if (++newlines > count) {
+                start = i + 1;
+                break;
+            }
+        }
+        if (start == -1 && window == size)
+            start = 0;
+        // a window as wide as it goes yields the whole lines it holds
+        else if (start == -1 && window == limit)
+            start = bytes.indexOf('\n') + 1;
+
+        if (start != -1) {
+            const QString text = QString::fromLocal8Bit(bytes.constData() + start, bytes.size() - start);
+            file.unmap(map);
+            return text.split(QLatin1Char('\n'), QString::SkipEmptyParts);
+        }
+
+        file.unmap(map);
+        window = qMin(limit, window * 4);
+    }
+    return QStringList();
+}
+
+// the newest segment rotated away from the file, if any
+static QString rotated(const QString& filePath)
+{
+    const QFileInfo info(filePath);
+    QStringList segments;
+    foreach (const QString& name, info.dir().entryList(QStringList(info.completeBaseName() + "-*"), QDir::Files)) {
+        if (LogArchive::activeName(name) == info.fileName())
+            segments += name;
+    }
+    if (segments.isEmpty())
+        return QString();
+
+    // the stamps sort by name
+    qSort(segments);
+    return info.dir().filePath(segments.last());
+}
+
+// the last lines of the newest segment rotated away from the file, if any
+static QStringList archived(const QString& filePath, int count)
+{
+    const QString segment = rotated(filePath);
+    if (segment.isEmpty() || count <= 0)
+        return QStringList();
+
+    // since frames only go forward the segment is streamed through,
+    // keeping no more than the lines asked for
+    LogArchive archive(segment);
+    if (!archive.open(QIODevice::ReadOnly))
+        return QStringList();
+
+    QQueue<QByteArray> ring;
+    for (QByteArray line = archive.readLine(); !line.isEmpty(); line = archive.readLine()) {
+        if (line.endsWith('\n'))
+            line.chop(1);
+        if (line.isEmpty())
+            continue;
+        ring.enqueue(line);
+        if (ring.count() > count)
+            ring.dequeue();
+    }
+
+    QStringList lines;
+    foreach (const QByteArray& line, ring)
+        lines += QString::fromLocal8Bit(line);
+    return lines;
+}
+
+// the last records of the structured log, topped up from its newest segment
+static QList<MessageLog::Record> recorded(const QString& filePath, int count, const QDateTime& to)
+{
+    QList<MessageLog::Record> records = MessageLog(filePath).last(count, to);
+    if (records.count() < count) {
+        const QString segment = rotated(filePath);
+        if (!segment.isEmpty())
+            records = MessageLog(segment).last(count - records.count(), to) + records;
+    }
+    return records;
+}
+
+class HistoryTask : public QRunnable
+{
+public:
+    HistoryTask(HistoryLoader* loader, int job, const QString& filePath, int count, bool structured)
+        : loader(loader), job(job), count(count), structured(structured), filePath(filePath) { }
+
+    void run()
+    {
+        // the structured log keeps every message whole, so it is replayed
+        // as it was received rather than parsed back from the text log
+        const QString recordPath = MessageLog::recordPath(filePath);
+        if (structured && QFile::exists(recordPath)) {
+            const QList<MessageLog::Record> records = recorded(recordPath, count, until.addMSecs(-1));
+            QMutexLocker locker(&mutex);
+            if (loaders.contains(loader))
+                QMetaObject::invokeMethod(loader, "replay", Qt::QueuedConnection, Q_ARG(int, job), Q_ARG(QList<MessageLog::Record>, records));
+            return;
+        }
+
+        // a freshly rotated file is topped up from the segment before it
+        QStringList text = tail(filePath, count);
+        if (text.count() < count)
+            text = archived(filePath, count - text.count()) + text;
+
+        QList<MessageData> lines;
+        foreach (const QString& line, text) {
+            // headers and lines of other formats don't parse
+            const QDateTime timestamp = QDateTime::fromString(line.left(stampLength), stampFormat);
+            const int colon = line.indexOf(QLatin1String(": "), stampLength + 1);
+            if (!timestamp.isValid() || timestamp >= until || colon == -1)
+                continue;
+
+            MessageSnapshot snapshot = prototype;
+            snapshot.timestamp = timestamp;
+            snapshot.nick = line.mid(stampLength + 1, colon - stampLength - 1);
+            snapshot.content = line.mid(colon + 2);
+            snapshot.own = !ownNick.isEmpty() && snapshot.nick == ownNick;
+            lines += MessageFormatter::formatSnapshot(snapshot, nicks, generation);
+        }
+
+        QMutexLocker locker(&mutex);
+        if (loaders.contains(loader))
+            QMetaObject::invokeMethod(loader, "complete", Qt::QueuedConnection, Q_ARG(int, job), Q_ARG(QList<MessageData>, lines));
+    }
+
+    HistoryLoader* loader;
+    int job;
+    int count;
+    bool structured;
+    int generation;
+    QString filePath;
+    QString ownNick;
+    QDateTime until;
+    NickMatcher nicks;
+    MessageSnapshot prototype;
+};
+
+HistoryLoader::HistoryLoader(QObject* parent) : QObject(parent)
+{
+    qRegisterMetaType<QList<MessageData> >();
+    qRegisterMetaType<QList<MessageLog::Record> >();
+
+    d.job = 0;
+
+    QMutexLocker locker(&mutex);
+    loaders.insert(this);
+}
+
+HistoryLoader::~HistoryLoader()
+{
+    QMutexLocker locker(&mutex);
+    loaders.remove(this);
+}
+
+void HistoryLoader::load(TextDocument* document, const QString& filePath, int count, bool structured)
+{
+    IrcBuffer* buffer = document->buffer();
+    MessageFormatter* formatter = document->formatter();
+
+    // everything the worker needs is taken here, on the gui thread
+    HistoryTask* task = new HistoryTask(this, ++d.job, filePath, count, structured);
+    task->generation = formatter->nickGeneration();
+    task->nicks = formatter->nickMatcher();
+    task->ownNick = buffer->connection()->nickName();
+    task->until = QDateTime::currentDateTime();
+    task->prototype.type = IrcMessage::Private;
+    task->prototype.target = buffer->title();
+    task->prototype.priv = !buffer->isChannel();
+
+    d.pending.insert(d.job, document);
+    FormatPipeline::workers()->start(task);
+}
+
+void HistoryLoader::complete(int job, const QList<MessageData>& lines)
+{
+    QPointer<TextDocument> document = d.pending.take(job);
+    if (document)
+        document->restore(lines);
+}
+
+void HistoryLoader::replay(int job, const QList<MessageLog::Record>& records)
+{
+    // formatted here, since the formatter and the connection live on this thread
+    QPointer<TextDocument> document = d.pending.take(job);
+    if (document)
+        document->restore(MessageLog::replay(records, document->formatter()));
+}
@@ -25,9 +25,20 @@ DEFINES += BUILD_BASE
 
 HEADERS += $$PWD/bufferview.h
 HEADERS += $$PWD/eventformatter.h
+HEADERS += $$PWD/flushscheduler.h
+HEADERS += $$PWD/formatcache.h
+HEADERS += $$PWD/formatpipeline.h
+HEADERS += $$PWD/linefilter.h
 HEADERS += $$PWD/listview.h
+HEADERS += $$PWD/logarchive.h
 HEADERS += $$PWD/messagedata.h
 HEADERS += $$PWD/messageformatter.h
+HEADERS += $$PWD/messagelog.h
+HEADERS += $$PWD/nickindex.h
+HEADERS += $$PWD/nicklookup.h
+HEADERS += $$PWD/nickmatcher.h
+HEADERS += $$PWD/searchindex.h
+HEADERS += $$PWD/styledtext.h
 HEADERS += $$PWD/textbrowser.h
 HEADERS += $$PWD/textdocument.h
 HEADERS += $$PWD/textinput.h
@@ -36,9 +47,20 @@ HEADERS += $$PWD/titlebar.h
 
 SOURCES += $$PWD/bufferview.cpp
 SOURCES += $$PWD/eventformatter.cpp
+SOURCES += $$PWD/flushscheduler.cpp
+SOURCES += $$PWD/formatcache.cpp
+SOURCES += $$PWD/formatpipeline.cpp
+SOURCES += $$PWD/linefilter.cpp
 SOURCES += $$PWD/listview.cpp
+SOURCES += $$PWD/logarchive.cpp
 SOURCES += $$PWD/messagedata.cpp
 SOURCES += $$PWD/messageformatter.cpp
+SOURCES += $$PWD/messagelog.cpp
+SOURCES += $$PWD/nickindex.cpp
+SOURCES += $$PWD/nicklookup.cpp
+SOURCES += $$PWD/nickmatcher.cpp
+SOURCES += $$PWD/searchindex.cpp
+SOURCES += $$PWD/styledtext.cpp
 SOURCES += $$PWD/textbrowser.cpp
 SOURCES += $$PWD/textdocument.cpp
 SOURCES += $$PWD/textinput.cpp
@@ -0,0 +1,158 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "flushscheduler.h"
+#include "textdocument.h"
+#include <QCoreApplication>
+#include <QTimerEvent>
+#include <QPointer>
+
+// hidden documents collect lines for a while before they are laid out
+static const int hiddenHoldoff = 1000;
+
+FlushScheduler::FlushScheduler(QObject* parent) : QObject(parent)
+{
+    d.timer = 0;
+    d.budget = 10;
+    d.latency = 0;
+    d.maximumLatency = 0;
+    d.clock.start();
+}
+
+FlushScheduler* FlushScheduler::instance()
+{
+    // owned by the application, so that it goes away along with the event loop
+    static QPointer<FlushScheduler> scheduler;
+    if (!scheduler)
+        scheduler = new FlushScheduler(qApp);
+    return scheduler;
+}
+
+int FlushScheduler::budget() const
+{
+    return d.budget;
+}
+
+void FlushScheduler::setBudget(int msecs)
+{
+    d.budget = qMax(1, msecs);
+}
+
+int FlushScheduler::queueDepth() const
+{
+    return d.pending.count();
+}
+
+int FlushScheduler::latency() const
+{
+    return d.latency;
+}
+
+int FlushScheduler::maximumLatency() const
+{
+    return d.maximumLatency;
+}
+
+void FlushScheduler::schedule(TextDocument* document)
+{
+    if (document && !d.pending.contains(document)) {
+        const qint64 now = d.clock.elapsed();
+        const qint64 deadline = now + holdoff(document);
+        d.pending.insert(document, qMakePair(now, deadline));
+        d.deadlines.insert(deadline, document);
+
+        // only a new earliest deadline moves the timer
+        if (d.deadlines.firstKey() == deadline)
+            restart();
+    }
+}
+
+void FlushScheduler::cancel(TextDocument* document)
+{
+    QHash<TextDocument*, QPair<qint64, qint64> >::iterator it = d.pending.find(document);
+    if (it != d.pending.end()) {
+        d.deadlines.remove(it->second, document);
+        d.pending.erase(it);
+    }
+}
+
+void FlushScheduler::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() != d.timer) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    killTimer(d.timer);
+    d.timer = 0;
+
+    // the deadlines are ordered, so only the documents that are due are looked at
+    const qint64 now = d.clock.elapsed();
+    QMultiMap<QPair<int, qint64>, TextDocument*> due;
+    QMultiMap<qint64, TextDocument*>::const_iterator it;
+    for (it = d.deadlines.constBegin(); it != d.deadlines.constEnd() && it.key() <= now; ++it)
+        due.insert(qMakePair(it.value()->flushPriority(), d.pending.value(it.value()).first), it.value());
+
+    // at least one document per iteration, then as many as the budget allows
+    QElapsedTimer elapsed;
+    elapsed.start();
+    QMultiMap<QPair<int, qint64>, TextDocument*>::const_iterator next;
+    for (next = due.constBegin(); next != due.constEnd(); ++next) {
+        if (next != due.constBegin() && elapsed.elapsed() >= d.budget)
+            break;
+        TextDocument* document = next.value();
+        if (!d.pending.contains(document))
+            continue;
+        const int wait = int(d.clock.elapsed() - d.pending.value(document).first);
+        cancel(document);
+        document->flush();
+        d.latency = wait;
+        d.maximumLatency = qMax(d.maximumLatency, wait);
+        emit flushed(d.pending.count(), wait);
+    }
+
+    restart();
+}
+
+void FlushScheduler::restart()
+{
+    if (d.timer) {
+        killTimer(d.timer);
+        d.timer = 0;
+    }
+
+    if (!d.deadlines.isEmpty()) {
+        const qint64 wait = d.deadlines.firstKey() - d.clock.elapsed();
+        d.timer = startTimer(int(qMax<qint64>(0, wait)));
+    }
+}
+
+int FlushScheduler::holdoff(TextDocument* document) const
+{
+    return document->isVisible() ? 0 : hiddenHoldoff;
+}
@@ -0,0 +1,81 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FLUSHSCHEDULER_H
+#define FLUSHSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QMultiMap>
+#include <QObject>
+#include <QHash>
+#include <QPair>
+#include "baseglobal.h"
+
+class TextDocument;
+
+class BASE_EXPORT FlushScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static FlushScheduler* instance();
+
+    int budget() const;
+    void setBudget(int msecs);
+
+    int queueDepth() const;
+    int latency() const;
+    int maximumLatency() const;
+
+public slots:
+    void schedule(TextDocument* document);
+    void cancel(TextDocument* document);
+
+signals:
+    void flushed(int depth, int latency);
+
+protected:
+    void timerEvent(QTimerEvent* event);
+
+private:
+    explicit FlushScheduler(QObject* parent = 0);
+    void restart();
+    int holdoff(TextDocument* document) const;
+
+    struct Private {
+        int timer;
+        int budget;
+        int latency;
+        int maximumLatency;
+        QElapsedTimer clock;
+        QHash<TextDocument*, QPair<qint64, qint64> > pending;
+        QMultiMap<qint64, TextDocument*> deadlines;
+    } d;
+};
+
+#endif // FLUSHSCHEDULER_H
@@ -0,0 +1,98 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "formatcache.h"
+#include <QMutexLocker>
+
+FormatCache::FormatCache()
+{
+    d.hits = 0;
+    d.misses = 0;
+    d.entries.setMaxCost(2000);
+}
+
+FormatCache* FormatCache::instance()
+{
+    static FormatCache cache;
+    return &cache;
+}
+
+int FormatCache::capacity() const
+{
+    QMutexLocker locker(&d.mutex);
+    return d.entries.maxCost();
+}
+
+void FormatCache::setCapacity(int capacity)
+{
+    QMutexLocker locker(&d.mutex);
+    d.entries.setMaxCost(qMax(0, capacity));
+}
+
+int FormatCache::hits() const
+{
+    QMutexLocker locker(&d.mutex);
+    return d.hits;
+}
+
+int FormatCache::misses() const
+{
+    QMutexLocker locker(&d.mutex);
+    return d.misses;
+}
+
+void FormatCache::resetStats()
+{
+    QMutexLocker locker(&d.mutex);
+    d.hits = 0;
+    d.misses = 0;
+}
+
+bool FormatCache::find(int generation, const QString& text, QString* html)
+{
+    QMutexLocker locker(&d.mutex);
+    // QCache::object() also marks the entry as most recently used
+    if (QString* entry = d.entries.object(qMakePair(generation, text))) {
+        *html = *entry;
+        ++d.hits;
+        return true;
+    }
+    ++d.misses;
+    return false;
+}
+
+void FormatCache::insert(int generation, const QString& text, const QString& html)
+{
+    QMutexLocker locker(&d.mutex);
+    d.entries.insert(qMakePair(generation, text), new QString(html));
+}
+
+void FormatCache::clear()
+{
+    QMutexLocker locker(&d.mutex);
+    d.entries.clear();
+}
@@ -0,0 +1,189 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "formatpipeline.h"
+#include "messageformatter.h"
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <IrcMessage>
+#include <QRunnable>
+#include <QThread>
+#include <QHash>
+
+// workers report back by id, so a pipeline that is gone never gets called
+static QMutex mutex;
+static QHash<int, FormatPipeline*> pipelines;
+static int nextId = 0;
+
+class WorkerPool : public QThreadPool
+{
+public:
+    WorkerPool()
+    {
+        // leave a core for the gui thread
+        setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    }
+};
+
+class FormatTask : public QRunnable
+{
+public:
+    FormatTask(int pipeline, int ticket, const MessageSnapshot& snapshot, const NickMatcher& nicks, int generation)
+        : pipeline(pipeline), ticket(ticket), generation(generation), snapshot(snapshot), nicks(nicks) { }
+
+    void run()
+    {
+        const MessageData data = MessageFormatter::formatSnapshot(snapshot, nicks, generation);
+
+        QMutexLocker locker(&mutex);
+        if (FormatPipeline* target = pipelines.value(pipeline))
+            QMetaObject::invokeMethod(target, "complete", Qt::QueuedConnection, Q_ARG(int, ticket), Q_ARG(MessageData, data));
+    }
+
+private:
+    int pipeline;
+    int ticket;
+    int generation;
+    MessageSnapshot snapshot;
+    NickMatcher nicks;
+};
+
+FormatPipeline::FormatPipeline(MessageFormatter* formatter, QObject* parent) : QObject(parent)
+{
+    qRegisterMetaType<MessageData>();
+
+    d.ticket = 0;
+    d.formatter = formatter;
+
+    QMutexLocker locker(&mutex);
+    d.id = ++nextId;
+    pipelines.insert(d.id, this);
+}
+
+FormatPipeline::~FormatPipeline()
+{
+    QMutexLocker locker(&mutex);
+    pipelines.remove(d.id);
+}
+
+QThreadPool* FormatPipeline::workers()
+{
+    static WorkerPool pool;
+    return &pool;
+}
+
+MessageFormatter* FormatPipeline::formatter() const
+{
+    return d.formatter;
+}
+
+bool FormatPipeline::isIdle() const
+{
+    return d.queue.isEmpty();
+}
+
+int FormatPipeline::pendingCount() const
+{
+    return d.queue.count();
+}
+
+void FormatPipeline::submit(IrcMessage* message)
+{
+    // own messages are formatted in place once everything before them is
+    // done, since plugins look up their lines as soon as they are announced
+    const bool concurrent = !message->isOwn() && d.formatter->canFormatSnapshot(message);
+    if (message->isOwn())
+        finish();
+
+    if (!concurrent && d.queue.isEmpty()) {
+        // nothing to wait for, format in place
+        const MessageData data = d.formatter->formatMessage(message);
+        if (!data.isEmpty())
+            emit formatted(message, data);
+        return;
+    }
+
+    Entry entry;
+    entry.ticket = ++d.ticket;
+    entry.ready = false;
+    entry.generation = 0;
+
+    if (concurrent) {
+        // the nick index compiles its matcher ahead, taking it is a copy
+        entry.snapshot = MessageSnapshot(message);
+        entry.nicks = d.formatter->nickMatcher();
+        entry.generation = d.formatter->nickGeneration();
+        d.queue += entry;
+        workers()->start(new FormatTask(d.id, entry.ticket, entry.snapshot, entry.nicks, entry.generation));
+    } else {
+        // formatted now against the current buffer state, delivered in turn
+        entry.data = d.formatter->formatMessage(message);
+        entry.ready = true;
+        d.queue += entry;
+    }
+
+    // the message is announced while it is still around, its line follows
+    emit submitted(entry.ticket, message);
+}
+
+void FormatPipeline::complete(int ticket, const MessageData& data)
+{
+    for (int i = 0; i < d.queue.count(); ++i) {
+        if (d.queue.at(i).ticket == ticket) {
+            d.queue[i].data = data;
+            d.queue[i].ready = true;
+            if (i == 0)
+                deliver();
+            break;
+        }
+    }
+}
+
+void FormatPipeline::finish()
+{
+    // what the workers have not returned yet is formatted here instead,
+    // and their results are ignored once the tickets are gone
+    for (int i = 0; i < d.queue.count(); ++i) {
+        Entry& entry = d.queue[i];
+        if (!entry.ready) {
+            entry.data = MessageFormatter::formatSnapshot(entry.snapshot, entry.nicks, entry.generation);
+            entry.ready = true;
+        }
+    }
+    if (!d.queue.isEmpty())
+        deliver();
+}
+
+void FormatPipeline::deliver()
+{
+    while (!d.queue.isEmpty() && d.queue.first().ready) {
+        const Entry entry = d.queue.takeFirst();
+        emit completed(entry.ticket, entry.data);
+    }
+    if (d.queue.isEmpty())
+        emit drained();
+}
@@ -0,0 +1,89 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef FORMATPIPELINE_H
+#define FORMATPIPELINE_H
+
+#include <QObject>
+#include <QList>
+#include "baseglobal.h"
+#include "messagedata.h"
+#include "nickmatcher.h"
+
+class IrcMessage;
+class QThreadPool;
+class MessageFormatter;
+
+class BASE_EXPORT FormatPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FormatPipeline(MessageFormatter* formatter, QObject* parent = 0);
+    ~FormatPipeline();
+
+    static QThreadPool* workers();
+
+    MessageFormatter* formatter() const;
+
+    bool isIdle() const;
+    int pendingCount() const;
+
+public slots:
+    void submit(IrcMessage* message);
+
+signals:
+    void formatted(IrcMessage* message, const MessageData& data);
+    void submitted(int ticket, IrcMessage* message);
+    void completed(int ticket, const MessageData& data);
+    void drained();
+
+private slots:
+    void complete(int ticket, const MessageData& data);
+
+private:
+    void finish();
+    void deliver();
+
+    struct Entry {
+        int ticket;
+        bool ready;
+        int generation;
+        NickMatcher nicks;
+        MessageSnapshot snapshot;
+        MessageData data;
+    };
+
+    struct Private {
+        int id;
+        int ticket;
+        MessageFormatter* formatter;
+        QList<Entry> queue;
+    } d;
+};
+
+#endif // FORMATPIPELINE_H
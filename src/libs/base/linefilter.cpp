@@ -0,0 +1,129 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "linefilter.h"
+#include "messagedata.h"
+
+LineFilter::LineFilter()
+{
+    d.events = false;
+    d.highlights = false;
+}
+
+// "nick:<nick>", "type:<type>" and "is:highlight" terms match fields of
+// the line, whatever is left is matched against its text. terms of the
+// same kind match any of their values, different kinds must all match.
+LineFilter::LineFilter(const QString& query)
+{
+    d.events = false;
+    d.highlights = false;
+    d.query = query;
+
+    QStringList words;
+    foreach (const QString& word, query.split(QLatin1Char(' '), QString::SkipEmptyParts)) {
+        const QString key = word.section(QLatin1Char(':'), 0, 0).toLower();
+        const QString value = word.section(QLatin1Char(':'), 1);
+        if (key == QLatin1String("nick") && !value.isEmpty()) {
+            d.nicks += value;
+        } else if (key == QLatin1String("is") && value.toLower() == QLatin1String("highlight")) {
+            d.highlights = true;
+        } else if (key == QLatin1String("type") && !value.isEmpty()) {
+            const QString type = value.toLower();
+            if (type == QLatin1String("message"))
+                d.types += IrcMessage::Private;
+            else if (type == QLatin1String("notice"))
+                d.types += IrcMessage::Notice;
+            else if (type == QLatin1String("join"))
+                d.types += IrcMessage::Join;
+            else if (type == QLatin1String("part"))
+                d.types += IrcMessage::Part;
+            else if (type == QLatin1String("quit"))
+                d.types += IrcMessage::Quit;
+            else if (type == QLatin1String("kick"))
+                d.types += IrcMessage::Kick;
+            else if (type == QLatin1String("mode"))
+                d.types += IrcMessage::Mode;
+            else if (type == QLatin1String("nick"))
+                d.types += IrcMessage::Nick;
+            else if (type == QLatin1String("topic"))
+                d.types += IrcMessage::Topic;
+            else if (type == QLatin1String("error"))
+                d.types += IrcMessage::Error;
+            else if (type == QLatin1String("event"))
+                d.events = true;
+            else
+                words += word;
+        } else {
+            words += word;
+        }
+    }
+    d.text = words.join(QLatin1String(" "));
+}
+
+bool LineFilter::isEmpty() const
+{
+    return d.text.isEmpty() && d.nicks.isEmpty() && d.types.isEmpty() && !d.events && !d.highlights;
+}
+
+QString LineFilter::query() const
+{
+    return d.query;
+}
+
+QString LineFilter::text() const
+{
+    return d.text;
+}
+
+bool LineFilter::matches(const MessageData& data, bool highlighted) const
+{
+    if (d.highlights && !highlighted)
+        return false;
+
+    if (!d.types.isEmpty() || d.events) {
+        if (!d.types.contains(data.type()) && !(d.events && data.isEvent()))
+            return false;
+    }
+
+    if (!d.nicks.isEmpty()) {
+        // merged events match any of their nicks
+        bool found = false;
+        foreach (const MessageData& event, data.getEvents()) {
+            foreach (const QString& nick, d.nicks) {
+                if (!event.nick().compare(nick, Qt::CaseInsensitive)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (found)
+                break;
+        }
+        if (!found)
+            return false;
+    }
+    return true;
+}
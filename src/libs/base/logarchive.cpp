@@ -0,0 +1,225 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "logarchive.h"
+#include <QRegularExpression>
+#include <QDataStream>
+#include <QFileInfo>
+#include <IrcNetwork>
+#include <IrcBuffer>
+
+// raw bytes per compressed frame, so that a reader only ever holds one
+// frame in memory while it streams through an archive
+static const int frameSize = 1024 * 1024;
+
+LogArchive::LogArchive(const QString& filePath, QObject* parent) : QIODevice(parent)
+{
+    d.file.setFileName(filePath);
+    d.compressed = isCompressed(filePath);
+    d.position = 0;
+}
+
+LogArchive::~LogArchive()
+{
+    close();
+}
+
+QString LogArchive::suffix()
+{
+    return QStringLiteral(".z");
+}
+
+QString LogArchive::logFileName(IrcBuffer* buffer)
+{
+    // the logger, the history preload and the search all agree on this name
+    return buffer->network()->name() + "_" + buffer->title() + ".log";
+}
+
+bool LogArchive::isCompressed(const QString& filePath)
+{
+    return filePath.endsWith(suffix());
+}
+
+QString LogArchive::activeName(const QString& fileName)
+{
+    // "network_title-yyyyMMdd-hhmmss.log.z" was rotated away from "network_title.log"
+    static const QRegularExpression rotated("-\\d{8}-\\d{6}(\\.[^.]+)$");
+    QString name = fileName;
+    if (isCompressed(name))
+        name.chop(suffix().length());
+    return name.replace(rotated, "\\1");
+}
+
+QString LogArchive::rotatedPath(const QString& filePath, const QDateTime& timestamp)
+{
+    const QString stamp = timestamp.toString("-yyyyMMdd-hhmmss");
+    const int dot = filePath.lastIndexOf(QLatin1Char('.'));
+    if (dot <= filePath.lastIndexOf(QLatin1Char('/')))
+        return filePath + stamp;
+    return filePath.left(dot) + stamp + filePath.mid(dot);
+}
+
+bool LogArchive::compress(const QString& filePath, QList<qint64>* frames)
+{
+    QFile source(filePath);
+    if (!source.open(QIODevice::ReadOnly))
+        return false;
+
+    // written aside and renamed when done, so readers never see half an archive
+    const QString target = filePath + suffix();
+    QFile archive(target + ".tmp");
+    if (!archive.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream out(&archive);
+    while (!source.atEnd()) {
+        if (frames)
+            *frames += archive.pos();
+        const QByteArray frame = qCompress(source.read(frameSize));
+        out << quint32(frame.size());
+        out.writeRawData(frame.constData(), frame.size());
+    }
+    archive.close();
+    source.close();
+
+    if (out.status() != QDataStream::Ok || archive.error() != QFile::NoError || !archive.rename(target)) {
+        archive.remove();
+        return false;
+    }
+    return source.remove();
+}
+
+qint64 LogArchive::framePosition(const QList<qint64>& frames, qint64 offset)
+{
+    // frame n holds the raw bytes from n * frameSize on, so a raw offset
+    // becomes where its frame starts in the archive and how far into it
+    const qint64 frame = offset / frameSize;
+    if (offset < 0 || frame >= frames.count())
+        return -1;
+    return frames.at(frame) * frameSize + offset % frameSize;
+}
+
+bool LogArchive::open(OpenMode mode)
+{
+    if (mode & WriteOnly)
+        return false;
+
+    d.position = 0;
+    d.frame.clear();
+    if (!d.file.open(QIODevice::ReadOnly))
+        return false;
+    return QIODevice::open(mode & ~Text);
+}
+
+void LogArchive::close()
+{
+    d.position = 0;
+    d.frame.clear();
+    d.file.close();
+    QIODevice::close();
+}
+
+bool LogArchive::isSequential() const
+{
+    return true;
+}
+
+qint64 LogArchive::bytesAvailable() const
+{
+    qint64 available = QIODevice::bytesAvailable() + d.frame.size() - d.position;
+    if (d.compressed)
+        available += d.file.atEnd() ? 0 : 1;
+    else
+        available += d.file.bytesAvailable();
+    return available;
+}
+
+bool LogArchive::seekFrame(qint64 position)
+{
+    if (!isOpen() || !d.compressed || position < 0)
+        return false;
+
+    // whatever was read ahead belongs to the old position
+    const OpenMode mode = openMode();
+    QIODevice::close();
+    QIODevice::open(mode);
+
+    // only the frame that is landed in is uncompressed
+    if (!d.file.seek(position / frameSize) || !readFrame())
+        return false;
+    const int offset = int(position % frameSize);
+    if (offset > d.frame.size())
+        return false;
+    d.position = offset;
+    return true;
+}
+
+qint64 LogArchive::readData(char* data, qint64 maxSize)
+{
+    if (!d.compressed)
+        return d.file.read(data, maxSize);
+
+    // frames are uncompressed one at a time, as the reader gets to them
+    qint64 read = 0;
+    while (read < maxSize) {
+        if (d.position >= d.frame.size() && !readFrame())
+            break;
+        const int count = int(qMin<qint64>(maxSize - read, d.frame.size() - d.position));
+        memcpy(data + read, d.frame.constData() + d.position, count);
+        d.position += count;
+        read += count;
+    }
+    return read;
+}
+
+qint64 LogArchive::writeData(const char* data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+bool LogArchive::readFrame()
+{
+    d.position = 0;
+    d.frame.clear();
+    while (d.frame.isEmpty() && !d.file.atEnd()) {
+        quint32 size = 0;
+        QDataStream in(&d.file);
+        in >> size;
+        if (in.status() != QDataStream::Ok)
+            return false;
+        const QByteArray compressed = d.file.read(size);
+        if (compressed.size() != int(size))
+            return false;
+        d.frame = qUncompress(compressed);
+        if (d.frame.isEmpty())
+            return false;
+    }
+    return !d.frame.isEmpty();
+}
@@ -0,0 +1,80 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LOGARCHIVE_H
+#define LOGARCHIVE_H
+
+#include <QDateTime>
+#include <QIODevice>
+#include <QString>
+#include <QList>
+#include <QFile>
+#include "baseglobal.h"
+
+class IrcBuffer;
+
+class BASE_EXPORT LogArchive : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit LogArchive(const QString& filePath, QObject* parent = 0);
+    ~LogArchive();
+
+    static QString suffix();
+    static QString logFileName(IrcBuffer* buffer);
+    static bool isCompressed(const QString& filePath);
+    static QString activeName(const QString& fileName);
+    static QString rotatedPath(const QString& filePath, const QDateTime& timestamp);
+    static bool compress(const QString& filePath, QList<qint64>* frames = 0);
+    static qint64 framePosition(const QList<qint64>& frames, qint64 offset);
+
+    bool open(OpenMode mode);
+    void close();
+
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+
+    bool seekFrame(qint64 position);
+
+protected:
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char* data, qint64 maxSize);
+
+private:
+    bool readFrame();
+
+    struct Private {
+        QFile file;
+        bool compressed;
+        int position;
+        QByteArray frame;
+    } d;
+};
+
+#endif // LOGARCHIVE_H
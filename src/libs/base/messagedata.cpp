@@ -27,13 +27,87 @@
 */
 
 #include "messagedata.h"
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QCache>
+#include <limits>
 
-MessageData::MessageData()
+static const qint64 invalidTimestamp = std::numeric_limits<qint64>::min();
+
+// the pool lets go of the least recently seen names beyond this many,
+// lines keep the copies they have
+static const int maximumInterned = 16384;
+
+// nicks and targets repeat across countless lines, so all lines share one copy of each
+static QString intern(const QString& name)
+{
+    static QMutex mutex;
+    static QCache<QString, QString> names(maximumInterned);
+
+    if (name.isEmpty())
+        return name;
+
+    QMutexLocker locker(&mutex);
+    QString* shared = names.object(name);
+    if (!shared) {
+        shared = new QString(name);
+        names.insert(name, shared);
+    }
+    return *shared;
+}
+
+MessageSnapshot::MessageSnapshot()
+{
+    type = IrcMessage::Unknown;
+    own = false;
+    reply = false;
+    action = false;
+    request = false;
+    priv = false;
+}
+
+MessageSnapshot::MessageSnapshot(IrcMessage* message)
+{
+    type = MessageData::effectiveType(message);
+    own = message->isOwn();
+    reply = false;
+    action = false;
+    request = false;
+    priv = false;
+    nick = message->nick();
+    timestamp = message->timeStamp();
+
+    if (type == IrcMessage::Private) {
+        IrcPrivateMessage* pm = static_cast<IrcPrivateMessage*>(message);
+        action = pm->isAction();
+        request = pm->isRequest();
+        priv = pm->isPrivate();
+        target = pm->target();
+        content = pm->content();
+        statusPrefix = pm->statusPrefix();
+    } else if (type == IrcMessage::Notice) {
+        IrcNoticeMessage* nm = static_cast<IrcNoticeMessage*>(message);
+        reply = nm->isReply();
+        priv = nm->isPrivate();
+        target = nm->target();
+        content = nm->content();
+        statusPrefix = nm->statusPrefix();
+    }
+}
+
+MessageData::MessageData() : d(new Private)
 {
-    d.own = false;
-    d.error = false;
-    d.reply = false;
-    d.type = IrcMessage::Unknown;
+    d->body = -1;
+    d->bodyLength = 0;
+    d->timestamp = invalidTimestamp;
+    d->offset = 0;
+    d->spec = Qt::LocalTime;
+    d->own = false;
+    d->error = false;
+    d->reply = false;
+    d->action = false;
+    d->request = false;
+    d->type = IrcMessage::Unknown;
 }
 
 IrcMessage::Type MessageData::effectiveType(const IrcMessage* msg)
@@ -60,29 +134,48 @@ IrcMessage::Type MessageData::effectiveType(const IrcMessage* msg)
 
 bool MessageData::isEmpty() const
 {
-    return d.format.isEmpty();
+    return d->format.isEmpty();
 }
 
 bool MessageData::isEvent() const
 {
-    return !d.reply &&
-           (d.type == IrcMessage::Join ||
-            d.type == IrcMessage::Kick ||
-            d.type == IrcMessage::Mode ||
-            d.type == IrcMessage::Nick ||
-            d.type == IrcMessage::Part ||
-            d.type == IrcMessage::Quit ||
-            d.type == IrcMessage::Topic);
+    return !d->reply &&
+           (d->type == IrcMessage::Join ||
+            d->type == IrcMessage::Kick ||
+            d->type == IrcMessage::Mode ||
+            d->type == IrcMessage::Nick ||
+            d->type == IrcMessage::Part ||
+            d->type == IrcMessage::Quit ||
+            d->type == IrcMessage::Topic);
 }
 
 bool MessageData::isError() const
 {
-    return d.error || d.type == IrcMessage::Error;
+    return d->error || d->type == IrcMessage::Error;
+}
+
+bool MessageData::isCollapsed() const
+{
+    // an expanded reply has its fields formatted and dropped
+    return (d->type == IrcMessage::Motd ||
+            d->type == IrcMessage::Names ||
+            d->type == IrcMessage::Whois ||
+            d->type == IrcMessage::Whowas) && !d->data.isEmpty();
+}
+
+QStringList MessageData::fields() const
+{
+    QStringList fields;
+    if (isCollapsed()) {
+        QDataStream in(d->data);
+        in >> fields;
+    }
+    return fields;
 }
 
 QList<MessageData> MessageData::getEvents() const
 {
-    QList<MessageData> events = d.events;
+    QList<MessageData> events = d->events;
     if (events.isEmpty())
         events += *this;
     return events;
@@ -90,61 +183,200 @@ QList<MessageData> MessageData::getEvents() const
 
 bool MessageData::canMerge(const MessageData& other) const
 {
-    return isEvent() && (!d.own || d.type != IrcMessage::Join)
-           && other.isEvent() && (!other.d.own || other.d.type != IrcMessage::Join)
-           && d.timestamp.date() == other.d.timestamp.date();
+    return isEvent() && (!d->own || d->type != IrcMessage::Join)
+           && other.isEvent() && (!other.d->own || other.d->type != IrcMessage::Join)
+           && timestamp().date() == other.timestamp().date();
 }
 
 void MessageData::merge(const MessageData& other)
 {
-    d.events = other.getEvents() << *this;
+    d->events = other.getEvents() << *this;
 }
 
 void MessageData::initFrom(IrcMessage* message)
 {
-    d.timestamp = message->timeStamp();
-    d.data = message->toData();
-    d.nick = message->nick();
-    d.type = effectiveType(message);
-    d.own = message->isOwn();
-    d.reply = message->property("reply").toBool();
+    setTimestamp(message->timeStamp());
+    d->nick = intern(message->nick());
+    d->type = effectiveType(message);
+    d->own = message->isOwn();
+    d->reply = message->property("reply").toBool();
+    d->action = false;
+    d->request = false;
+    d->target.clear();
+    d->content.clear();
+    d->body = -1;
+    d->data = message->toData();
 
     if (message->type() == IrcMessage::Quit) {
         QString reason = static_cast<IrcQuitMessage*>(message)->reason();
         if (reason.contains("Ping timeout")
                 || reason.contains("Connection reset by peer")
                 || reason.contains("Remote host closed the connection")) {
-            d.error = true;
+            d->error = true;
         }
     }
 }
 
+void MessageData::initFrom(const MessageSnapshot& snapshot)
+{
+    setTimestamp(snapshot.timestamp);
+    d->nick = intern(snapshot.nick);
+    d->type = snapshot.type;
+    d->own = snapshot.own;
+    d->reply = snapshot.reply;
+    d->error = false;
+
+    // private messages and notices keep their content instead of the raw
+    // message, which data() puts back together when it is asked for
+    d->action = snapshot.action;
+    d->request = snapshot.request;
+    d->target = intern(snapshot.target);
+    d->content = snapshot.content;
+    d->body = -1;
+    d->data.clear();
+}
+
 QString MessageData::format() const
 {
-    return d.format;
+    return d->format;
 }
 
 void MessageData::setFormat(const QString& format)
 {
-    d.format = format;
+    // the content is taken out of the old format before it goes
+    if (d->body != -1) {
+        d->content = content();
+        d->body = -1;
+    }
+    d->format = format;
+    d->runs.clear();
+}
+
+void MessageData::shareContent(const QString& html)
+{
+    // plain content shows up in the format escaped and nothing more, so
+    // the line keeps where it is instead of a copy of its own
+    if (d->content.isEmpty() || d->body != -1 || html != d->content.toHtmlEscaped())
+        return;
+    const int position = d->format.lastIndexOf(html);
+    if (position == -1)
+        return;
+    d->body = position;
+    d->bodyLength = html.length();
+    d->content.clear();
+}
+
+QString MessageData::content() const
+{
+    if (d->body == -1)
+        return d->content;
+
+    QString content = d->format.mid(d->body, d->bodyLength);
+    content.replace(QLatin1String("&lt;"), QLatin1String("<"));
+    content.replace(QLatin1String("&gt;"), QLatin1String(">"));
+    content.replace(QLatin1String("&quot;"), QLatin1String("\""));
+    content.replace(QLatin1String("&amp;"), QLatin1String("&"));
+    return content;
+}
+
+QList<StyledText::Run> MessageData::runs() const
+{
+    return d->runs;
+}
+
+void MessageData::setRuns(const QList<StyledText::Run>& runs)
+{
+    // read without detaching, dropping runs that are not there copies nothing
+    if (!runs.isEmpty() || !d.constData()->runs.isEmpty())
+        d->runs = runs;
 }
 
 QString MessageData::nick() const
 {
-    return d.nick;
+    return d->nick;
 }
 
 QByteArray MessageData::data() const
 {
-    return d.data;
+    if (!d->data.isEmpty() || (d->type != IrcMessage::Private && d->type != IrcMessage::Notice) || d->target.isEmpty())
+        return d->data;
+
+    QString content = this->content();
+    if (d->action)
+        content = QStringLiteral("\1ACTION %1\1").arg(content);
+    else if (d->request || d->reply)
+        content = QStringLiteral("\1%1\1").arg(content);
+
+    QString tags;
+    if (d->timestamp != invalidTimestamp)
+        tags = QStringLiteral("@time=%1 ").arg(timestamp().toUTC().toString(QStringLiteral("yyyy-MM-dd'T'hh:mm:ss.zzz'Z'")));
+    const QString command = d->type == IrcMessage::Notice ? QStringLiteral("NOTICE") : QStringLiteral("PRIVMSG");
+    return QStringLiteral("%1:%2 %3 %4 :%5").arg(tags, d->nick, command, d->target, content).toUtf8();
+}
+
+void MessageData::setData(const QByteArray& data)
+{
+    d->data = data;
+}
+
+bool MessageData::hasTimestamp() const
+{
+    return d->timestamp != invalidTimestamp;
+}
+
+qint64 MessageData::timestampMSecs() const
+{
+    return d->timestamp;
 }
 
 QDateTime MessageData::timestamp() const
 {
-    return d.timestamp;
+    if (d->timestamp == invalidTimestamp)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(d->timestamp, d->spec, d->offset);
+}
+
+void MessageData::setTimestamp(const QDateTime& timestamp)
+{
+    d->timestamp = timestamp.isValid() ? timestamp.toMSecsSinceEpoch() : invalidTimestamp;
+
+    // time zones are kept as the offset they had at the time
+    d->spec = timestamp.timeSpec();
+    d->offset = 0;
+    if (d->spec == Qt::OffsetFromUTC || d->spec == Qt::TimeZone) {
+        d->spec = Qt::OffsetFromUTC;
+        d->offset = timestamp.offsetFromUtc();
+    }
 }
 
 IrcMessage::Type MessageData::type() const
 {
-    return d.type;
+    return d->type;
+}
+
+QDataStream& operator<<(QDataStream& out, const MessageData& data)
+{
+    out << data.d->own << data.d->error << data.d->reply << data.d->action << data.d->request;
+    out << data.d->nick << data.d->target << data.content() << data.d->format << data.d->data;
+    out << data.d->timestamp << qint32(data.d->spec) << qint32(data.d->offset);
+    out << qint32(data.d->type) << data.d->events;
+    return out;
+}
+
+QDataStream& operator>>(QDataStream& in, MessageData& data)
+{
+    qint32 type = IrcMessage::Unknown;
+    qint32 spec = Qt::LocalTime;
+    qint32 offset = 0;
+    in >> data.d->own >> data.d->error >> data.d->reply >> data.d->action >> data.d->request;
+    in >> data.d->nick >> data.d->target >> data.d->content >> data.d->format >> data.d->data;
+    in >> data.d->timestamp >> spec >> offset;
+    in >> type >> data.d->events;
+    data.d->type = static_cast<IrcMessage::Type>(type);
+    data.d->spec = static_cast<Qt::TimeSpec>(spec);
+    data.d->offset = offset;
+    data.d->body = -1;
+    data.d->nick = intern(data.d->nick);
+    data.d->target = intern(data.d->target);
+    return in;
 }
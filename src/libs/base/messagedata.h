@@ -29,11 +29,37 @@
 #ifndef MESSAGEDATA_H
 #define MESSAGEDATA_H
 
-#include <QList>
-#include <QString>
+#include <QSharedDataPointer>
 #include <QDateTime>
 #include <IrcMessage>
+#include <QMetaType>
+#include <QStringList>
+#include <QString>
+#include <QList>
 #include "baseglobal.h"
+#include "styledtext.h"
+
+class QDataStream;
+
+// an immutable copy of what formatting needs from a private message or
+// notice, detached from the IrcMessage so that it can cross threads
+struct BASE_EXPORT MessageSnapshot
+{
+    MessageSnapshot();
+    explicit MessageSnapshot(IrcMessage* message);
+
+    IrcMessage::Type type;
+    bool own;
+    bool reply;
+    bool action;
+    bool request;
+    bool priv;
+    QString nick;
+    QString target;
+    QString content;
+    QString statusPrefix;
+    QDateTime timestamp;
+};
 
 class BASE_EXPORT MessageData
 {
@@ -45,32 +71,63 @@ public:
     bool isEmpty() const;
     bool isEvent() const;
     bool isError() const;
+    bool isCollapsed() const;
+    QStringList fields() const;
 
     QList<MessageData> getEvents() const;
     bool canMerge(const MessageData& other) const;
     void merge(const MessageData& other);
     void initFrom(IrcMessage* message);
+    void initFrom(const MessageSnapshot& snapshot);
 
     QString format() const;
     void setFormat(const QString& format);
+    void shareContent(const QString& html);
+
+    QList<StyledText::Run> runs() const;
+    void setRuns(const QList<StyledText::Run>& runs);
 
     QString nick() const;
     QByteArray data() const;
+    void setData(const QByteArray& data);
+    bool hasTimestamp() const;
+    qint64 timestampMSecs() const;
     QDateTime timestamp() const;
     IrcMessage::Type type() const;
 
 private:
-    struct Private {
+    QString content() const;
+    void setTimestamp(const QDateTime& timestamp);
+
+    friend BASE_EXPORT QDataStream& operator<<(QDataStream& out, const MessageData& data);
+    friend BASE_EXPORT QDataStream& operator>>(QDataStream& in, MessageData& data);
+
+    struct Private : public QSharedData {
         bool own;
         bool error;
         bool reply;
+        bool action;
+        bool request;
         QString nick;
+        QString target;
+        QString content;
         QString format;
+        QList<StyledText::Run> runs;
         QByteArray data;
-        QDateTime timestamp;
+        qint32 body;
+        qint32 bodyLength;
+        qint64 timestamp;
+        qint32 offset;
+        Qt::TimeSpec spec;
         IrcMessage::Type type;
         QList<MessageData> events;
-    } d;
+    };
+    QSharedDataPointer<Private> d;
 };
 
+BASE_EXPORT QDataStream& operator<<(QDataStream& out, const MessageData& data);
+BASE_EXPORT QDataStream& operator>>(QDataStream& in, MessageData& data);
+
+Q_DECLARE_METATYPE(MessageData)
+
 #endif // MESSAGEDATA_H
@@ -27,18 +27,18 @@
 */
 
 #include "messageformatter.h"
+#include "formatcache.h"
 #include <IrcTextFormat>
 #include <IrcConnection>
-#include <IrcUserModel>
 #include <IrcMessage>
 #include <IrcPalette>
 #include <IrcChannel>
 #include <Irc>
+#include <QThreadStorage>
 #include <QHash>
 #include <QTime>
 #include <QColor>
 #include <QCoreApplication>
-#include <QTextBoundaryFinder>
 
 static QString formatSeconds(int secs)
 {
@@ -61,14 +61,152 @@ static QString formatDuration(int secs)
     return idle.join(" ");
 }
 
+// orders names by their highest mode prefix first, then alphabetically
+struct TitleLessThan
+{
+    TitleLessThan(const QStringList& prefixes) : prefixes(prefixes) { }
+
+    int rank(const QString& title) const
+    {
+        const int index = prefixes.indexOf(title.left(1));
+        return index != -1 ? index : prefixes.count();
+    }
+
+    QString name(const QString& title) const
+    {
+        int i = 0;
+        while (i < title.length() && prefixes.contains(title.at(i)))
+            ++i;
+        return title.mid(i);
+    }
+
+    bool operator()(const QString& one, const QString& another) const
+    {
+        const int r1 = rank(one);
+        const int r2 = rank(another);
+        if (r1 != r2)
+            return r1 < r2;
+        return name(one).compare(name(another), Qt::CaseInsensitive) < 0;
+    }
+
+    QStringList prefixes;
+};
+
+// collapsed replies keep their fields and are only formatted when expanded
+static QByteArray packReply(IrcMessage* msg)
+{
+    QStringList fields;
+    switch (msg->type()) {
+        case IrcMessage::Motd:
+            fields = static_cast<IrcMotdMessage*>(msg)->lines();
+            break;
+        case IrcMessage::Names:
+            fields = static_cast<IrcNamesMessage*>(msg)->names();
+            break;
+        case IrcMessage::Whois: {
+            IrcWhoisMessage* m = static_cast<IrcWhoisMessage*>(msg);
+            fields << m->nick() << m->ident() << m->host() << m->realName() << m->server() << m->info()
+                   << m->since().toString(Qt::ISODate) << QString::number(m->idle()) << m->awayReason()
+                   << m->account() << m->address() << (m->isSecure() ? "1" : "") << m->channels().join(" ");
+            break;
+        }
+        case IrcMessage::Whowas: {
+            IrcWhowasMessage* m = static_cast<IrcWhowasMessage*>(msg);
+            fields << m->nick() << m->ident() << m->host() << m->realName() << m->server() << m->info() << m->account();
+            break;
+        }
+        default:
+            return QByteArray();
+    }
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << fields;
+    return data;
+}
+
+static QString formatLinks(const QString& html, const NickMatcher& nicks)
+{
+    const QList<NickMatcher::Match> matches = nicks.match(html);
+    if (matches.isEmpty())
+        return html;
+
+    // one pass over the message, linking every matched nick
+    QString linked;
+    int pos = 0;
+    foreach (const NickMatcher::Match& match, matches) {
+        const QString user = html.mid(match.position, match.length);
+        linked += html.midRef(pos, match.position - pos);
+        linked += QString("<a style='text-decoration:none;' href='nick:%1'>%2</a>").arg(user, MessageFormatter::styledText(user, MessageFormatter::Bold | MessageFormatter::Color));
+        pos = match.position + match.length;
+    }
+    linked += html.midRef(pos);
+    return linked;
+}
+
+static QString formatExpanderText(const QString& expander)
+{
+    return MessageFormatter::tr("<a href='expand:' class='event' style='text-decoration:none;'>%1</a>").arg(expander);
+}
+
+static QString formatPrivate(const MessageSnapshot& msg, const QString& sender, const QString& text)
+{
+    if (msg.request)
+        return MessageFormatter::tr("%1 %2 requested %3").arg(formatExpanderText("!"),
+                                                              sender,
+                                                              msg.content.split(" ").value(0).toUpper());
+
+    if (msg.action)
+        return MessageFormatter::tr("* %1 %2").arg(sender, text);
+
+    QString pfx = msg.statusPrefix;
+    if (!pfx.isEmpty())
+        pfx = MessageFormatter::styledText(":" + pfx, MessageFormatter::Dim);
+
+    return MessageFormatter::tr("&lt;<a style='text-decoration:none;' href='nick:%1'>%2</a>%3&gt; %4").arg(msg.nick,
+                                                                                                           sender,
+                                                                                                           pfx,
+                                                                                                           text);
+}
+
+static QString formatNotice(const MessageSnapshot& msg, const QString& sender, const QString& text)
+{
+    if (msg.reply) {
+        const QStringList params = msg.content.split(" ", QString::SkipEmptyParts);
+        const QString cmd = params.value(0);
+        if (cmd.toUpper() == "PING") {
+            const QString secs = formatSeconds(params.value(1).toInt());
+            return MessageFormatter::tr("! %1 replied in %2").arg(sender, secs);
+        } else if (cmd.toUpper() == "TIME") {
+            const QString rest = QStringList(params.mid(1)).join(" ");
+            return MessageFormatter::tr("! %1 time is %2").arg(sender, rest);
+        } else if (cmd.toUpper() == "VERSION") {
+            const QString rest = QStringList(params.mid(1)).join(" ");
+            return MessageFormatter::tr("! %1 version is %2").arg(sender, rest);
+        }
+    }
+
+    QString pfx = msg.statusPrefix;
+    if (!pfx.isEmpty())
+        pfx = MessageFormatter::styledText(":" + pfx, MessageFormatter::Dim);
+
+    if (msg.priv)
+        return MessageFormatter::tr("[%1%2] %3").arg(sender, pfx, text);
+
+    return MessageFormatter::tr("&lt;%1%2&gt; [%3] %4").arg(sender, pfx, msg.target, text);
+}
+
 MessageFormatter::MessageFormatter(QObject* parent) : QObject(parent)
 {
     d.buffer = 0;
     d.textFormat = new IrcTextFormat(this);
     d.textFormat->setSpanFormat(IrcTextFormat::SpanClass);
+}
 
-    d.userModel = new IrcUserModel(this);
-    connect(d.userModel, SIGNAL(namesChanged(QStringList)), this, SLOT(indexNames(QStringList)));
+MessageFormatter::~MessageFormatter()
+{
+    if (d.nicks)
+        d.nicks->release();
 }
 
 IrcBuffer* MessageFormatter::buffer() const
@@ -80,7 +218,9 @@ void MessageFormatter::setBuffer(IrcBuffer* buffer)
 {
     if (d.buffer != buffer) {
         d.buffer = buffer;
-        d.userModel->setChannel(qobject_cast<IrcChannel*>(buffer));
+        if (d.nicks)
+            d.nicks->release();
+        d.nicks = NickIndex::acquire(qobject_cast<IrcChannel*>(buffer));
     }
 }
 
@@ -161,60 +301,156 @@ MessageData MessageFormatter::formatMessage(IrcMessage* msg)
         default:
             break;
     }
-    return formatClass(fmt, msg);
+
+    MessageData data = formatClass(fmt, msg);
+    if (!data.isEmpty() && data.isCollapsed())
+        data.setData(packReply(msg));
+    return data;
+}
+
+QStringList MessageFormatter::formatReply(const MessageData& data) const
+{
+    const QStringList fields = data.fields();
+
+    QStringList lines;
+    switch (data.type()) {
+        case IrcMessage::Motd:
+            foreach (const QString& line, fields)
+                lines += tr("[MOTD] %1").arg(formatText(line));
+            break;
+        case IrcMessage::Names: {
+            QStringList prefixes;
+            if (d.buffer && d.buffer->network())
+                prefixes = d.buffer->network()->prefixes();
+            qSort(fields.begin(), fields.end(), TitleLessThan(prefixes));
+            for (int i = 0; i < fields.count(); i += 10)
+                lines += tr("[NAMES] %1").arg(QStringList(fields.mid(i, 10)).join(tr(" ")));
+            break;
+        }
+        case IrcMessage::Whois: {
+            if (fields.count() < 13)
+                break;
+            const QString nick = fields.at(0);
+            lines += tr("[WHOIS] %1 is %2@%3 (%4)").arg(nick, fields.at(1), fields.at(2), formatText(fields.at(3)));
+            lines += tr("[WHOIS] %1 is connected via %2 (%3)").arg(nick, fields.at(4), fields.at(5));
+            lines += tr("[WHOIS] %1 is connected since %2 (idle %3)").arg(nick, QDateTime::fromString(fields.at(6), Qt::ISODate).toString(), formatDuration(fields.at(7).toInt()));
+            if (!fields.at(8).isEmpty())
+                lines += tr("[WHOIS] %1 is away: %2").arg(nick, fields.at(8));
+            if (!fields.at(9).isEmpty())
+                lines += tr("[WHOIS] %1 is logged in as %2").arg(nick, fields.at(9));
+            if (!fields.at(10).isEmpty())
+                lines += tr("[WHOIS] %1 is connected from %2").arg(nick, fields.at(10));
+            if (!fields.at(11).isEmpty())
+                lines += tr("[WHOIS] %1 is using a secure connection").arg(nick);
+            if (!fields.at(12).isEmpty())
+                lines += tr("[WHOIS] %1 is on %2").arg(nick, fields.at(12));
+            break;
+        }
+        case IrcMessage::Whowas: {
+            if (fields.count() < 7)
+                break;
+            const QString nick = fields.at(0);
+            lines += tr("[WHOWAS] %1 was %2@%3 (%4)").arg(nick, fields.at(1), fields.at(2), formatText(fields.at(3)));
+            lines += tr("[WHOWAS] %1 was connected via %2 (%3)").arg(nick, fields.at(4), fields.at(5));
+            if (!fields.at(6).isEmpty())
+                lines += tr("[WHOWAS] %1 was logged in as %2").arg(nick, fields.at(6));
+            break;
+        }
+        default:
+            break;
+    }
+
+    for (int i = 0; i < lines.count(); ++i)
+        lines[i] = tr("<span class='event'>%1</span>").arg(lines.at(i));
+    return lines;
 }
 
 QString MessageFormatter::formatText(const QString& text) const
 {
-    d.textFormat->parse(text);
-
-    QString msg = d.textFormat->html();
-    if (!d.names.isEmpty()) {
-        QTextBoundaryFinder finder = QTextBoundaryFinder(QTextBoundaryFinder::Word, msg);
-        int pos = 0;
-        while (pos < msg.length()) {
-            const QChar c = msg.at(pos);
-            if (!c.isSpace()) {
-                // do not format nicks within links
-                if (c == '<' && msg.midRef(pos, 3) == "<a ") {
-                    const int end = msg.indexOf("</a>", pos + 3);
-                    if (end != -1) {
-                        pos = end + 4;
-                        continue;
-                    }
-                }
-                // test word start boundary
-                finder.setPosition(pos);
-                if (finder.isAtBoundary()) {
-                    QMultiHash<QChar, QString>::const_iterator it = d.names.find(c);
-                    while (it != d.names.constEnd() && it.key() == c) {
-                        const QString& user = it.value();
-                        if (msg.midRef(pos, user.length()) == user) {
-                            // test word end boundary
-                            finder.setPosition(pos + user.length());
-                            if (finder.isAtBoundary()) {
-                                const QString formatted = QString("<a style='text-decoration:none;' href='nick:%1'>%2</a>").arg(user, styledText(user, Bold | Color));
-                                msg.replace(pos, user.length(), formatted);
-                                pos += formatted.length();
-                                finder = QTextBoundaryFinder(QTextBoundaryFinder::Word, msg);
-                            }
-                        }
-                        ++it;
-                    }
-                }
-            }
-            ++pos;
+    // the same content formats the same for as long as the names stay the
+    // same, unless a custom text format has been set
+    QString html;
+    const int generation = nickGeneration();
+    const bool shared = d.textFormat->parent() == this;
+    if (!shared || !FormatCache::instance()->find(generation, text, &html)) {
+        d.textFormat->parse(text);
+        html = formatLinks(d.textFormat->html(), nickMatcher());
+        if (shared)
+            FormatCache::instance()->insert(generation, text, html);
+    }
+    return html;
+}
+
+int MessageFormatter::nickGeneration() const
+{
+    return d.nicks ? d.nicks->generation() : 0;
+}
+
+NickMatcher MessageFormatter::nickMatcher() const
+{
+    return d.nicks ? d.nicks->matcher() : NickMatcher();
+}
+
+bool MessageFormatter::canFormatSnapshot(IrcMessage* msg) const
+{
+    // subclasses and custom text formats take effect in formatMessage() only
+    if (metaObject() != &MessageFormatter::staticMetaObject || d.textFormat->parent() != this)
+        return false;
+
+    const IrcMessage::Type type = MessageData::effectiveType(msg);
+    return type == IrcMessage::Private || type == IrcMessage::Notice;
+}
+
+MessageData MessageFormatter::formatSnapshot(const MessageSnapshot& msg, const NickMatcher& nicks, int generation)
+{
+    QString text;
+    if (!FormatCache::instance()->find(generation, msg.content, &text)) {
+        // text formats are not shared across threads, each worker keeps its own
+        static QThreadStorage<IrcTextFormat*> formats;
+        if (!formats.hasLocalData()) {
+            IrcTextFormat* format = new IrcTextFormat;
+            format->setSpanFormat(IrcTextFormat::SpanClass);
+            formats.setLocalData(format);
         }
+
+        IrcTextFormat* format = formats.localData();
+        format->parse(msg.content);
+        text = formatLinks(format->html(), nicks);
+        FormatCache::instance()->insert(generation, msg.content, text);
     }
-    return msg;
+
+    Style style = Bold;
+    QString fmt, cls;
+    if (msg.type == IrcMessage::Private) {
+        if (!msg.action && !msg.request)
+            style |= msg.own ? Dim : Color;
+        fmt = formatPrivate(msg, styledText(msg.nick, style), text);
+        cls = msg.action ? "action" : msg.request ? "event" : "message";
+    } else {
+        fmt = formatNotice(msg, styledText(msg.nick, style), text);
+        cls = msg.reply ? "event" : "notice";
+    }
+
+    MessageData data;
+    data.initFrom(msg);
+    if (!fmt.isEmpty()) {
+        data.setFormat(tr("<span class='%1'>%2</span>").arg(cls, fmt));
+        data.shareContent(text);
+
+        // split into styled runs here, so that the gui thread lays them out as is
+        QList<StyledText::Run> runs;
+        if (StyledText::parse(data.format(), &runs))
+            data.setRuns(runs);
+    }
+    return data;
 }
 
 QString MessageFormatter::formatExpander(const QString& expander) const
 {
-    return tr("<a href='expand:' class='event' style='text-decoration:none;'>%1</a>").arg(expander);
+    return formatExpanderText(expander);
 }
 
-QString MessageFormatter::styledText(const QString& text, Style style) const
+QString MessageFormatter::styledText(const QString& text, Style style)
 {
     QString fmt = text;
     if (style & Bold)
@@ -279,11 +515,12 @@ QString MessageFormatter::formatModeMessage(IrcModeMessage* msg)
 
 QString MessageFormatter::formatMotdMessage(IrcMotdMessage *msg)
 {
-    foreach (const QString& line, msg->lines()) {
-        MessageData data = formatClass(tr("[MOTD] %1").arg(formatText(line)), msg);
-        emit formatted(data);
-    }
-    return QString();
+    const QStringList lines = msg->lines();
+    if (lines.isEmpty())
+        return QString();
+
+    return tr("%1 [MOTD] %2 lines").arg(formatExpander("!"),
+                                        QString::number(lines.count()));
 }
 
 QString MessageFormatter::formatNamesMessage(IrcNamesMessage* msg)
@@ -291,18 +528,9 @@ QString MessageFormatter::formatNamesMessage(IrcNamesMessage* msg)
     if (msg->flags() & IrcMessage::Implicit)
         return QString();
 
-    if (d.buffer) {
-        IrcUserModel userModel(d.buffer);
-        userModel.setSortMethod(Irc::SortByTitle);
-        QStringList titles = userModel.titles();
-        for (int i = 0; i < titles.count(); i += 10) {
-            QStringList row = titles.mid(i, 10);
-            MessageData data = formatClass(tr("[NAMES] %1").arg(row.join(tr(" "))), msg);
-            emit formatted(data);
-        }
-    }
-
-    return QString();
+    return tr("%1 [NAMES] %2 users on %3").arg(formatExpander("!"),
+                                               QString::number(msg->names().count()),
+                                               styledText(msg->channel(), Bold));
 }
 
 QString MessageFormatter::formatNickMessage(IrcNickMessage* msg)
@@ -313,34 +541,7 @@ QString MessageFormatter::formatNickMessage(IrcNickMessage* msg)
 
 QString MessageFormatter::formatNoticeMessage(IrcNoticeMessage* msg)
 {
-    if (msg->isReply()) {
-        const QStringList params = msg->content().split(" ", QString::SkipEmptyParts);
-        const QString cmd = params.value(0);
-        if (cmd.toUpper() == "PING") {
-            const QString secs = formatSeconds(params.value(1).toInt());
-            return tr("! %1 replied in %2").arg(formatSender(msg), secs);
-        } else if (cmd.toUpper() == "TIME") {
-            const QString rest = QStringList(params.mid(1)).join(" ");
-            return tr("! %1 time is %2").arg(formatSender(msg), rest);
-        } else if (cmd.toUpper() == "VERSION") {
-            const QString rest = QStringList(params.mid(1)).join(" ");
-            return tr("! %1 version is %2").arg(formatSender(msg), rest);
-        }
-    }
-
-    QString pfx = msg->statusPrefix();
-    if (!pfx.isEmpty())
-        pfx = styledText(":" + pfx, Dim);
-
-    if (msg->isPrivate())
-        return tr("[%1%2] %3").arg(formatSender(msg),
-                                   pfx,
-                                   formatText(msg->content()));
-
-    return tr("&lt;%1%2&gt; [%3] %4").arg(formatSender(msg),
-                                          pfx,
-                                          msg->target(),
-                                          formatText(msg->content()));
+    return formatNotice(MessageSnapshot(msg), formatSender(msg), formatText(msg->content()));
 }
 
 #define P_(x) msg->parameters().value(x)
@@ -395,23 +596,7 @@ QString MessageFormatter::formatPongMessage(IrcPongMessage* msg)
 
 QString MessageFormatter::formatPrivateMessage(IrcPrivateMessage* msg)
 {
-    if (msg->isRequest())
-        return tr("%1 %2 requested %3").arg(formatExpander("!"),
-                                            formatSender(msg),
-                                            msg->content().split(" ").value(0).toUpper());
-
-    if (msg->isAction())
-        return tr("* %1 %2").arg(formatSender(msg),
-                                 formatText(msg->content()));
-
-    QString pfx = msg->statusPrefix();
-    if (!pfx.isEmpty())
-        pfx = styledText(":" + pfx, Dim);
-
-    return tr("&lt;<a style='text-decoration:none;' href='nick:%1'>%2</a>%3&gt; %4").arg(msg->nick(),
-                                                                                         formatSender(msg),
-                                                                                         pfx,
-                                                                                         formatText(msg->content()));
+    return formatPrivate(MessageSnapshot(msg), formatSender(msg), formatText(msg->content()));
 }
 
 QString MessageFormatter::formatQuitMessage(IrcQuitMessage* msg)
@@ -456,29 +641,20 @@ QString MessageFormatter::formatUnknownMessage(IrcMessage* msg)
 
 QString MessageFormatter::formatWhoisMessage(IrcWhoisMessage* msg)
 {
-    emit formatted(formatClass(tr("[WHOIS] %1 is %2@%3 (%4)").arg(msg->nick(), msg->ident(), msg->host(), formatText(msg->realName())), msg));
-    emit formatted(formatClass(tr("[WHOIS] %1 is connected via %2 (%3)").arg(msg->nick(), msg->server(), msg->info()), msg));
-    emit formatted(formatClass(tr("[WHOIS] %1 is connected since %2 (idle %3)").arg(msg->nick(), msg->since().toString(), formatDuration(msg->idle())), msg));
-    if (!msg->awayReason().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is away: %2").arg(msg->nick(), msg->awayReason()), msg));
-    if (!msg->account().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is logged in as %2").arg(msg->nick(), msg->account()), msg));
-    if (!msg->address().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is connected from %2").arg(msg->nick(), msg->address()), msg));
-    if (msg->isSecure())
-        emit formatted(formatClass(tr("[WHOIS] %1 is using a secure connection").arg(msg->nick()), msg));
-    if (!msg->channels().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is on %2").arg(msg->nick(), msg->channels().join(" ")), msg));
-    return QString();
+    return tr("%1 [WHOIS] %2 is %3@%4 (%5)").arg(formatExpander("!"),
+                                                 msg->nick(),
+                                                 msg->ident(),
+                                                 msg->host(),
+                                                 formatText(msg->realName()));
 }
 
 QString MessageFormatter::formatWhowasMessage(IrcWhowasMessage* msg)
 {
-    emit formatted(formatClass(tr("[WHOWAS] %1 was %2@%3 (%4)").arg(msg->nick(), msg->ident(), msg->host(), formatText(msg->realName())), msg));
-    emit formatted(formatClass(tr("[WHOWAS] %1 was connected via %2 (%3)").arg(msg->nick(), msg->server(), msg->info()), msg));
-    if (!msg->account().isEmpty())
-        emit formatted(formatClass(tr("[WHOWAS] %1 was logged in as %2").arg(msg->nick(), msg->account()), msg));
-    return QString();
+    return tr("%1 [WHOWAS] %2 was %3@%4 (%5)").arg(formatExpander("!"),
+                                                   msg->nick(),
+                                                   msg->ident(),
+                                                   msg->host(),
+                                                   formatText(msg->realName()));
 }
 
 QString MessageFormatter::formatWhoReplyMessage(IrcWhoReplyMessage* msg)
@@ -553,11 +729,3 @@ QString MessageFormatter::formatSender(IrcMessage* msg) const
     return styledText(msg->nick(), style);
 }
 
-void MessageFormatter::indexNames(const QStringList& names)
-{
-    d.names.clear();
-    foreach (const QString& name, names) {
-        if (!name.isEmpty())
-            d.names.insert(name.at(0), name);
-    }
-}
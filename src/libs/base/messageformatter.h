@@ -31,15 +31,16 @@
 
 #include <QHash>
 #include <QColor>
+#include <QPointer>
 #include <QString>
 #include <QDateTime>
 #include <IrcGlobal>
 #include <IrcMessage>
 #include "baseglobal.h"
 #include "messagedata.h"
+#include "nickindex.h"
 
 class IrcBuffer;
-class IrcUserModel;
 class IrcTextFormat;
 
 class BASE_EXPORT MessageFormatter : public QObject
@@ -50,6 +51,7 @@ class BASE_EXPORT MessageFormatter : public QObject
 
 public:
     explicit MessageFormatter(QObject* parent = 0);
+    ~MessageFormatter();
 
     IrcBuffer* buffer() const;
     void setBuffer(IrcBuffer* buffer);
@@ -58,8 +60,14 @@ public:
     void setTextFormat(IrcTextFormat* format);
 
     MessageData formatMessage(IrcMessage* msg);
+    QStringList formatReply(const MessageData& data) const;
     QString formatText(const QString& text) const;
 
+    int nickGeneration() const;
+    NickMatcher nickMatcher() const;
+    bool canFormatSnapshot(IrcMessage* msg) const;
+    static MessageData formatSnapshot(const MessageSnapshot& msg, const NickMatcher& nicks, int generation);
+
     enum StyleFlag
     {
         None = 0x0,
@@ -69,10 +77,7 @@ public:
     };
     Q_DECLARE_FLAGS(Style, StyleFlag)
 
-    QString styledText(const QString& text, Style style) const;
-
-signals:
-    void formatted(const MessageData& msg);
+    static QString styledText(const QString& text, Style style);
 
 protected:
     virtual QString formatAwayMessage(IrcAwayMessage* msg);
@@ -100,15 +105,11 @@ protected:
     virtual QString formatSender(IrcMessage* msg) const;
     virtual QString formatExpander(const QString& expander) const;
 
-private slots:
-    void indexNames(const QStringList& names);
-
 private:
     struct Private {
         IrcBuffer* buffer;
-        IrcUserModel* userModel;
         IrcTextFormat* textFormat;
-        QMultiHash<QChar, QString> names;
+        QPointer<NickIndex> nicks;
     } d;
 };
 
@@ -0,0 +1,359 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "messagelog.h"
+#include "messageformatter.h"
+#include "logarchive.h"
+#include <IrcConnection>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QQueue>
+#include <QDir>
+#include <IrcMessage>
+#include <IrcBuffer>
+#include <limits>
+
+// a segment holds the records written out together, behind a header of
+// magic, payload size and payload checksum
+static const quint32 segmentMagic = 0x434d4c47; // "CMLG"
+// the bytes of that header
+static const int headerSize = 2 * sizeof(quint32) + sizeof(quint16);
+// anything bigger is taken for a corrupt header
+static const quint32 maximumSegment = 64 * 1024 * 1024;
+// log bytes between two entries of the sparse time index
+static const qint64 spacing = 64 * 1024;
+// an index entry is a timestamp and the offset of the segment it starts,
+// which in a compressed log is the frame position of the segment
+static const int entrySize = 2 * sizeof(qint64);
+
+QString MessageLog::recordPath(const QString& logPath)
+{
+    // "network_title.mlog" sits next to "network_title.log"
+    const QFileInfo info(logPath);
+    return info.dir().filePath(info.completeBaseName() + ".mlog");
+}
+
+QString MessageLog::indexPath(const QString& filePath)
+{
+    return filePath + ".idx";
+}
+
+qint64 MessageLog::indexSpacing()
+{
+    return spacing;
+}
+
+QByteArray MessageLog::encode(const QList<Record>& records)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    foreach (const Record& record, records)
+        out << record.timestamp << qint32(record.type) << record.data;
+
+    QByteArray segment;
+    QDataStream stream(&segment, QIODevice::WriteOnly);
+    stream << segmentMagic << quint32(payload.size()) << qChecksum(payload.constData(), payload.size());
+    stream.writeRawData(payload.constData(), payload.size());
+    return segment;
+}
+
+QByteArray MessageLog::indexEntry(qint64 timestamp, qint64 offset)
+{
+    QByteArray entry;
+    QDataStream out(&entry, QIODevice::WriteOnly);
+    out << timestamp << offset;
+    return entry;
+}
+
+bool MessageLog::compress(const QString& filePath)
+{
+    QList<qint64> frames;
+    if (!LogArchive::compress(filePath, &frames))
+        return false;
+
+    // the index goes along with the log, pointing into its frames
+    QFile index(indexPath(filePath));
+    if (!index.open(QIODevice::ReadOnly))
+        return true;
+    const QString target = indexPath(filePath + LogArchive::suffix());
+    QFile compressed(target + ".tmp");
+    if (!compressed.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream in(&index);
+    while (!in.atEnd()) {
+        qint64 timestamp = 0;
+        qint64 offset = 0;
+        in >> timestamp >> offset;
+        if (in.status() != QDataStream::Ok)
+            break;
+        const qint64 position = LogArchive::framePosition(frames, offset);
+        if (position != -1)
+            compressed.write(indexEntry(timestamp, position));
+    }
+    compressed.close();
+    index.close();
+
+    QFile::remove(target);
+    if (compressed.error() != QFile::NoError || !compressed.rename(target)) {
+        compressed.remove();
+        return false;
+    }
+    return index.remove();
+}
+
+QList<MessageData> MessageLog::replay(const QList<Record>& records, MessageFormatter* formatter)
+{
+    QList<MessageData> lines;
+    IrcConnection* connection = formatter->buffer() ? formatter->buffer()->connection() : 0;
+    foreach (const Record& record, records) {
+        IrcMessage* msg = IrcMessage::fromData(record.data, connection);
+        if (msg) {
+            msg->setTimeStamp(QDateTime::fromMSecsSinceEpoch(record.timestamp));
+            const MessageData data = formatter->formatMessage(msg);
+            if (!data.isEmpty())
+                lines += data;
+            delete msg;
+        }
+    }
+    return lines;
+}
+
+MessageLog::MessageLog(const QString& filePath)
+{
+    d.file.setFileName(filePath);
+    d.archive = 0;
+    d.device = &d.file;
+    d.from = std::numeric_limits<qint64>::min();
+    d.next = 0;
+}
+
+MessageLog::~MessageLog()
+{
+    close();
+}
+
+bool MessageLog::open()
+{
+    d.next = 0;
+    d.records.clear();
+    if (!LogArchive::isCompressed(d.file.fileName())) {
+        d.device = &d.file;
+        return d.file.open(QIODevice::ReadOnly);
+    }
+
+    // a rotated log is streamed a frame at a time, and its index tells
+    // which frame to start uncompressing at
+    delete d.archive;
+    d.archive = new LogArchive(d.file.fileName());
+    d.device = d.archive;
+    return d.archive->open(QIODevice::ReadOnly);
+}
+
+void MessageLog::close()
+{
+    d.next = 0;
+    d.records.clear();
+    d.device->close();
+    delete d.archive;
+    d.archive = 0;
+    d.device = &d.file;
+}
+
+bool MessageLog::seek(const QDateTime& from)
+{
+    if (!d.device->isOpen())
+        return false;
+
+    d.from = from.isValid() ? from.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+
+    // start at the last indexed segment that is not newer than the time,
+    // records before the time are then skipped as they are read
+    qint64 offset = 0;
+    QFile index(indexPath(d.file.fileName()));
+    if (from.isValid() && index.open(QIODevice::ReadOnly)) {
+        QDataStream in(&index);
+        int lo = 0;
+        int hi = index.size() / entrySize;
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            qint64 timestamp = 0;
+            qint64 position = 0;
+            index.seek(mid * entrySize);
+            in >> timestamp >> position;
+            if (timestamp <= d.from) {
+                if (d.archive || position < d.file.size())
+                    offset = position;
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+    return rewind(offset);
+}
+
+bool MessageLog::read(Record* record)
+{
+    forever {
+        while (d.next < d.records.count()) {
+            const Record& next = d.records.at(d.next++);
+            if (next.timestamp >= d.from) {
+                *record = next;
+                return true;
+            }
+        }
+        d.next = 0;
+        d.records.clear();
+        if (!readSegment())
+            return false;
+    }
+}
+
+QList<MessageLog::Record> MessageLog::read(const QDateTime& from, const QDateTime& to)
+{
+    QList<Record> records;
+    if (!d.device->isOpen() && !open())
+        return records;
+
+    seek(from);
+    const qint64 until = to.isValid() ? to.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+    Record record;
+    while (read(&record) && record.timestamp <= until)
+        records += record;
+    return records;
+}
+
+QList<MessageLog::Record> MessageLog::last(int count, const QDateTime& to)
+{
+    QQueue<Record> records;
+    if (count <= 0 || (!d.device->isOpen() && !open()))
+        return records;
+
+    // the indexed segments are read from the newest back, stepping further
+    // each time, until enough records are found on the way to the end
+    QList<qint64> starts = QList<qint64>() << 0;
+    QFile index(indexPath(d.file.fileName()));
+    if (index.open(QIODevice::ReadOnly)) {
+        QDataStream in(&index);
+        while (!in.atEnd()) {
+            qint64 timestamp = 0;
+            qint64 position = 0;
+            in >> timestamp >> position;
+            if (in.status() != QDataStream::Ok)
+                break;
+            if (position > starts.last() && (d.archive || position < d.file.size()))
+                starts += position;
+        }
+    }
+
+    const qint64 until = to.isValid() ? to.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+    d.from = std::numeric_limits<qint64>::min();
+    int step = 1;
+    for (int i = starts.count() - 1; ; i = qMax(0, i - step), step *= 2) {
+        records.clear();
+        if (!rewind(starts.at(i)) && i > 0)
+            continue;
+        Record record;
+        while (read(&record) && record.timestamp <= until) {
+            records.enqueue(record);
+            if (records.count() > count)
+                records.dequeue();
+        }
+        if (records.count() >= count || i == 0)
+            return records;
+    }
+}
+
+bool MessageLog::rewind(qint64 offset)
+{
+    d.next = 0;
+    d.records.clear();
+    if (d.archive)
+        return d.archive->seekFrame(offset) || d.archive->seekFrame(0);
+    return d.device->seek(offset);
+}
+
+bool MessageLog::readSegment()
+{
+    while (!d.device->atEnd()) {
+        // looked at before it is taken, so that a bad header or a bad size
+        // only ever costs a byte and never the segments that follow it
+        const QByteArray header = d.device->peek(headerSize);
+        if (header.size() < headerSize)
+            return false;
+
+        quint32 magic = 0;
+        quint32 size = 0;
+        quint16 checksum = 0;
+        QDataStream in(header);
+        in >> magic >> size >> checksum;
+
+        if (magic == segmentMagic && size <= maximumSegment) {
+            const QByteArray segment = d.device->peek(headerSize + size);
+            if (segment.size() == headerSize + int(size) && qChecksum(segment.constData() + headerSize, size) == checksum) {
+                d.device->read(segment.size());
+                QDataStream records(segment.mid(headerSize));
+                while (!records.atEnd()) {
+                    Record record;
+                    qint32 type = 0;
+                    records >> record.timestamp >> type >> record.data;
+                    if (records.status() != QDataStream::Ok)
+                        break;
+                    record.type = type;
+                    d.records += record;
+                }
+                return true;
+            }
+        }
+
+        // a torn write or a damaged segment, carry on from the byte after it began
+        d.device->read(1);
+        if (!resync())
+            return false;
+    }
+    return false;
+}
+
+bool MessageLog::resync()
+{
+    QByteArray marker;
+    QDataStream out(&marker, QIODevice::WriteOnly);
+    out << segmentMagic;
+
+    // scanned forward only, which works for a file and an archive alike
+    forever {
+        const QByteArray chunk = d.device->peek(64 * 1024);
+        if (chunk.size() < marker.size())
+            return false;
+        const int index = chunk.indexOf(marker);
+        if (index != -1)
+            return d.device->read(index).size() == index;
+        d.device->read(chunk.size() - marker.size() + 1);
+    }
+}
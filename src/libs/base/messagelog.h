@@ -0,0 +1,91 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MESSAGELOG_H
+#define MESSAGELOG_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+#include <QFile>
+#include <QList>
+#include "baseglobal.h"
+#include "messagedata.h"
+
+class MessageFormatter;
+class LogArchive;
+
+class BASE_EXPORT MessageLog
+{
+public:
+    struct Record {
+        Record() : timestamp(0), type(0) { }
+        qint64 timestamp;
+        int type;
+        QByteArray data;
+    };
+
+    static QString recordPath(const QString& logPath);
+    static QString indexPath(const QString& filePath);
+    static qint64 indexSpacing();
+
+    static QByteArray encode(const QList<Record>& records);
+    static QByteArray indexEntry(qint64 timestamp, qint64 offset);
+    static bool compress(const QString& filePath);
+
+    static QList<MessageData> replay(const QList<Record>& records, MessageFormatter* formatter);
+
+    explicit MessageLog(const QString& filePath);
+    ~MessageLog();
+
+    bool open();
+    void close();
+
+    bool seek(const QDateTime& from);
+    bool read(Record* record);
+    QList<Record> read(const QDateTime& from, const QDateTime& to);
+    QList<Record> last(int count, const QDateTime& to);
+
+private:
+    bool rewind(qint64 offset);
+    bool readSegment();
+    bool resync();
+
+    struct Private {
+        QFile file;
+        LogArchive* archive;
+        QIODevice* device;
+        qint64 from;
+        int next;
+        QList<Record> records;
+    } d;
+};
+
+Q_DECLARE_METATYPE(MessageLog::Record)
+
+#endif // MESSAGELOG_H
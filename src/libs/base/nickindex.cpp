@@ -0,0 +1,217 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nickindex.h"
+#include <IrcUserModel>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <IrcChannel>
+#include <QRunnable>
+#include <IrcUser>
+#include <QSet>
+
+// generations are unique across all indexes, so that a generation alone
+// identifies one particular set of names
+static int generations = 0;
+
+// compilers report back only to indexes that are still around
+static QMutex mutex;
+static QSet<NickIndex*> indexes;
+
+class NickCompiler : public QRunnable
+{
+public:
+    NickCompiler(NickIndex* index, int generation, const QStringList& names)
+        : index(index), generation(generation), names(names) { }
+
+    void run()
+    {
+        NickMatcher matcher;
+        matcher.setNames(names);
+
+        QMutexLocker locker(&mutex);
+        if (indexes.contains(index))
+            QMetaObject::invokeMethod(index, "onMatcherCompiled", Qt::QueuedConnection,
+                                      Q_ARG(int, generation), Q_ARG(NickMatcher, matcher));
+    }
+
+private:
+    NickIndex* index;
+    int generation;
+    QStringList names;
+};
+
+NickIndex::NickIndex(IrcChannel* channel) : QObject(channel)
+{
+    d.refs = 0;
+    d.generation = ++generations;
+    d.compiling = false;
+    d.compiled = 0;
+    d.channel = channel;
+
+    qRegisterMetaType<NickMatcher>();
+    {
+        QMutexLocker locker(&mutex);
+        indexes.insert(this);
+    }
+
+    // an unsorted model is enough to follow joins, parts, nicks and quits
+    d.model = new IrcUserModel(this);
+    connect(d.model, SIGNAL(added(IrcUser*)), this, SLOT(onUserAdded(IrcUser*)));
+    connect(d.model, SIGNAL(removed(IrcUser*)), this, SLOT(onUserRemoved(IrcUser*)));
+    connect(d.model, SIGNAL(modelReset()), this, SLOT(onUsersReset()));
+    connect(d.model, SIGNAL(countChanged(int)), this, SIGNAL(countChanged(int)));
+    d.model->setChannel(channel);
+}
+
+NickIndex::~NickIndex()
+{
+    QMutexLocker locker(&mutex);
+    indexes.remove(this);
+}
+
+NickIndex* NickIndex::acquire(IrcChannel* channel)
+{
+    if (!channel)
+        return 0;
+
+    // one index per channel, shared by all documents, formatters and views
+    NickIndex* index = channel->findChild<NickIndex*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!index)
+        index = new NickIndex(channel);
+    ++index->d.refs;
+    return index;
+}
+
+void NickIndex::release()
+{
+    if (--d.refs <= 0) {
+        // not to be found again by acquire() while pending deletion
+        setParent(0);
+        deleteLater();
+    }
+}
+
+IrcChannel* NickIndex::channel() const
+{
+    return d.channel;
+}
+
+int NickIndex::count() const
+{
+    return d.users.count();
+}
+
+QStringList NickIndex::names() const
+{
+    return d.users.values();
+}
+
+int NickIndex::generation() const
+{
+    // the names the matcher was compiled from, which may lag behind
+    return d.compiled;
+}
+
+const NickMatcher& NickIndex::matcher() const
+{
+    // compiled lazily on a worker, the previous matcher stays in use
+    // until the new one is ready
+    if (d.compiled != d.generation)
+        compile();
+    return d.matcher;
+}
+
+const NickLookup& NickIndex::lookup() const
+{
+    // unlike the matcher, kept up to date as users come and go
+    return d.lookup;
+}
+
+void NickIndex::onUserAdded(IrcUser* user)
+{
+    d.users.insert(user, user->name());
+    d.lookup.insert(user, user->name());
+    connect(user, SIGNAL(nameChanged(QString)), this, SLOT(onUserRenamed(QString)));
+    changed();
+}
+
+void NickIndex::onUserRemoved(IrcUser* user)
+{
+    disconnect(user, SIGNAL(nameChanged(QString)), this, SLOT(onUserRenamed(QString)));
+    d.lookup.remove(user);
+    if (d.users.remove(user))
+        changed();
+}
+
+void NickIndex::onUserRenamed(const QString& name)
+{
+    IrcUser* user = qobject_cast<IrcUser*>(sender());
+    if (user && d.users.contains(user)) {
+        d.users.insert(user, name);
+        d.lookup.insert(user, name);
+        changed();
+    }
+}
+
+void NickIndex::onUsersReset()
+{
+    foreach (IrcUser* user, d.users.keys())
+        disconnect(user, SIGNAL(nameChanged(QString)), this, SLOT(onUserRenamed(QString)));
+    d.users.clear();
+    d.lookup.clear();
+    foreach (IrcUser* user, d.model->users()) {
+        d.users.insert(user, user->name());
+        d.lookup.insert(user, user->name());
+        connect(user, SIGNAL(nameChanged(QString)), this, SLOT(onUserRenamed(QString)));
+    }
+    changed();
+}
+
+void NickIndex::onMatcherCompiled(int generation, const NickMatcher& matcher)
+{
+    // names that changed meanwhile are compiled when next asked for
+    d.compiling = false;
+    d.compiled = generation;
+    d.matcher = matcher;
+}
+
+void NickIndex::changed()
+{
+    d.generation = ++generations;
+    emit namesChanged();
+}
+
+void NickIndex::compile() const
+{
+    // one compiler at a time, however fast the names change
+    if (d.compiling)
+        return;
+    d.compiling = true;
+    QThreadPool::globalInstance()->start(new NickCompiler(const_cast<NickIndex*>(this), d.generation, names()));
+}
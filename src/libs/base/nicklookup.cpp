@@ -0,0 +1,122 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nicklookup.h"
+
+static quint64 trigram(const QChar* s)
+{
+    return quint64(s[0].unicode()) << 32 | quint64(s[1].unicode()) << 16 | s[2].unicode();
+}
+
+int NickLookup::count() const
+{
+    return d.keys.count();
+}
+
+void NickLookup::clear()
+{
+    d.keys.clear();
+    d.users.clear();
+    d.sorted.clear();
+    d.postings.clear();
+}
+
+void NickLookup::insert(IrcUser* user, const QString& name)
+{
+    remove(user);
+
+    const QString key = name.toCaseFolded();
+    d.keys.insert(user, key);
+    d.users.insert(key, user);
+    d.sorted.insert(key, user);
+    for (int i = 0; i + 2 < key.length(); ++i)
+        d.postings[trigram(key.constData() + i)].insert(user);
+}
+
+void NickLookup::remove(IrcUser* user)
+{
+    const QString key = d.keys.take(user);
+    if (key.isNull())
+        return;
+
+    if (d.users.value(key) == user)
+        d.users.remove(key);
+    d.sorted.remove(key, user);
+    for (int i = 0; i + 2 < key.length(); ++i) {
+        QHash<quint64, QSet<IrcUser*> >::iterator it = d.postings.find(trigram(key.constData() + i));
+        if (it != d.postings.end()) {
+            it->remove(user);
+            if (it->isEmpty())
+                d.postings.erase(it);
+        }
+    }
+}
+
+IrcUser* NickLookup::find(const QString& name) const
+{
+    return d.users.value(name.toCaseFolded());
+}
+
+QList<IrcUser*> NickLookup::startingWith(const QString& text) const
+{
+    const QString key = text.toCaseFolded();
+
+    // the names that start with the text sort right after it
+    QList<IrcUser*> users;
+    QMultiMap<QString, IrcUser*>::const_iterator it;
+    for (it = d.sorted.lowerBound(key); it != d.sorted.constEnd() && it.key().startsWith(key); ++it)
+        users += it.value();
+    return users;
+}
+
+QList<IrcUser*> NickLookup::containing(const QString& text) const
+{
+    const QString key = text.toCaseFolded();
+
+    // too short for a trigram, the first keystrokes go by the start of the name
+    if (key.length() < 3)
+        return startingWith(key);
+
+    QList<IrcUser*> users;
+
+    // the rarest trigram of the text bounds the candidates, which are then verified
+    const QSet<IrcUser*>* rarest = 0;
+    for (int i = 0; i + 2 < key.length(); ++i) {
+        QHash<quint64, QSet<IrcUser*> >::const_iterator it = d.postings.constFind(trigram(key.constData() + i));
+        if (it == d.postings.constEnd())
+            return users;
+        if (!rarest || it->count() < rarest->count())
+            rarest = &it.value();
+    }
+
+    foreach (IrcUser* user, *rarest) {
+        if (key.length() == 3 || d.keys.value(user).contains(key))
+            users += user;
+    }
+    return users;
+}
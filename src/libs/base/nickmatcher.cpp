@@ -0,0 +1,183 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nickmatcher.h"
+
+// a multi-pattern (Aho-Corasick) automaton over all nicks of a channel,
+// so that a message is scanned once no matter how many nicks there are
+
+static inline quint64 edge(int state, QChar c)
+{
+    return (quint64(state) << 16) | c.unicode();
+}
+
+static inline bool isWordChar(QChar c)
+{
+    return c.isLetterOrNumber() || c.isMark() || c == QLatin1Char('_');
+}
+
+static inline bool isBoundary(const QString& text, int pos)
+{
+    if (pos <= 0 || pos >= text.length())
+        return true;
+    return !isWordChar(text.at(pos - 1)) || !isWordChar(text.at(pos));
+}
+
+static bool matchesBefore(const NickMatcher::Match& one, const NickMatcher::Match& another)
+{
+    if (one.position != another.position)
+        return one.position < another.position;
+    return one.length > another.length;
+}
+
+NickMatcher::NickMatcher()
+{
+    setNames(QStringList());
+}
+
+bool NickMatcher::isEmpty() const
+{
+    return d.edges.isEmpty();
+}
+
+void NickMatcher::setNames(const QStringList& names)
+{
+    d.edges.clear();
+    d.fail = QVector<int>(1, 0);
+    d.output = QVector<int>(1, 0);
+    d.depth = QVector<int>(1, 0);
+    d.terminal = QVector<bool>(1, false);
+
+    // build the trie, remembering the edges level by level
+    QVector<QList<QPair<int, QChar> > > levels;
+    foreach (const QString& name, names) {
+        int state = 0;
+        foreach (const QChar& c, name) {
+            int next = d.edges.value(edge(state, c), -1);
+            if (next == -1) {
+                next = d.depth.count();
+                d.edges.insert(edge(state, c), next);
+                d.fail += 0;
+                d.output += 0;
+                d.depth += d.depth.at(state) + 1;
+                d.terminal += false;
+                if (levels.count() < d.depth.at(next))
+                    levels.resize(d.depth.at(next));
+                levels[d.depth.at(next) - 1] += qMakePair(state, c);
+            }
+            state = next;
+        }
+        if (state)
+            d.terminal[state] = true;
+    }
+
+    // failure links in breadth-first order, and for each state the
+    // nearest state on its failure chain that completes a nick
+    for (int level = 1; level < levels.count(); ++level) {
+        foreach (const QPair<int, QChar>& pair, levels.at(level)) {
+            const int child = d.edges.value(edge(pair.first, pair.second));
+            const int fail = transition(d.fail.at(pair.first), pair.second);
+            d.fail[child] = fail;
+            d.output[child] = d.terminal.at(fail) ? fail : d.output.at(fail);
+        }
+    }
+}
+
+QList<NickMatcher::Match> NickMatcher::match(const QString& html) const
+{
+    QList<Match> candidates;
+    if (isEmpty())
+        return candidates;
+
+    int state = 0;
+    int pos = 0;
+    const int length = html.length();
+    while (pos < length) {
+        const QChar c = html.at(pos);
+
+        // markup is not matched, and links are skipped as a whole
+        if (c == QLatin1Char('<')) {
+            int end = -1;
+            if (html.midRef(pos, 3) == QLatin1String("<a ")) {
+                end = html.indexOf(QLatin1String("</a>"), pos + 3);
+                if (end != -1)
+                    end += 3;
+            }
+            if (end == -1)
+                end = html.indexOf(QLatin1Char('>'), pos);
+            if (end != -1) {
+                pos = end + 1;
+                state = 0;
+                continue;
+            }
+        } else if (c == QLatin1Char('&')) {
+            const int end = html.indexOf(QLatin1Char(';'), pos);
+            if (end != -1 && end - pos <= 8) {
+                pos = end + 1;
+                state = 0;
+                continue;
+            }
+        }
+
+        state = transition(state, c);
+        int found = d.terminal.at(state) ? state : d.output.at(state);
+        while (found) {
+            Match match;
+            match.length = d.depth.at(found);
+            match.position = pos + 1 - match.length;
+            if (isBoundary(html, match.position) && isBoundary(html, pos + 1))
+                candidates += match;
+            found = d.output.at(found);
+        }
+        ++pos;
+    }
+
+    // leftmost-longest, without overlaps
+    qSort(candidates.begin(), candidates.end(), matchesBefore);
+    QList<Match> matches;
+    int end = 0;
+    foreach (const Match& match, candidates) {
+        if (match.position >= end) {
+            matches += match;
+            end = match.position + match.length;
+        }
+    }
+    return matches;
+}
+
+int NickMatcher::transition(int state, QChar c) const
+{
+    forever {
+        const int next = d.edges.value(edge(state, c), -1);
+        if (next != -1)
+            return next;
+        if (!state)
+            return 0;
+        state = d.fail.at(state);
+    }
+}
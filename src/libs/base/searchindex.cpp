@@ -0,0 +1,169 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "searchindex.h"
+#include <QSet>
+#include <QtAlgorithms>
+
+static quint64 trigram(const QChar* s)
+{
+    return quint64(s[0].unicode()) << 32 | quint64(s[1].unicode()) << 16 | s[2].unicode();
+}
+
+static QSet<quint64> trigrams(const QString& text)
+{
+    QSet<quint64> grams;
+    QString folded = text.toCaseFolded();
+    folded.replace(QChar::Nbsp, QLatin1Char(' '));
+    for (int i = 0; i + 2 < folded.length(); ++i)
+        grams.insert(trigram(folded.constData() + i));
+    return grams;
+}
+
+SearchIndex::SearchIndex()
+{
+    clear();
+}
+
+int SearchIndex::minimumLength()
+{
+    return 3;
+}
+
+bool SearchIndex::isEmpty() const
+{
+    return d.first > d.last;
+}
+
+qint64 SearchIndex::first() const
+{
+    return d.first;
+}
+
+qint64 SearchIndex::last() const
+{
+    return d.last;
+}
+
+void SearchIndex::clear()
+{
+    d.first = 0;
+    d.last = -1;
+    d.removed = 0;
+    d.count = 0;
+    d.postings.clear();
+}
+
+void SearchIndex::add(qint64 sequence, const QString& text)
+{
+    // lines come in at either end, new ones after and paged in ones before
+    const bool append = isEmpty() || sequence > d.last;
+    if (!append && sequence >= d.first)
+        return;
+
+    foreach (quint64 gram, trigrams(text)) {
+        QVector<qint64>& list = d.postings[gram];
+        if (append)
+            list.append(sequence);
+        else
+            list.insert(qLowerBound(list.begin(), list.end(), sequence), sequence);
+    }
+
+    if (isEmpty()) {
+        d.first = sequence;
+        d.last = sequence;
+    } else if (append) {
+        d.last = sequence;
+    } else {
+        d.first = sequence;
+    }
+    ++d.count;
+}
+
+void SearchIndex::removeBefore(qint64 sequence)
+{
+    if (isEmpty() || sequence <= d.first)
+        return;
+
+    if (sequence > d.last) {
+        clear();
+        return;
+    }
+
+    // evicted lines are only dropped from the postings once they outnumber the rest
+    d.removed += sequence - d.first;
+    d.count -= sequence - d.first;
+    d.first = sequence;
+    if (d.removed > d.count)
+        compact();
+}
+
+QList<qint64> SearchIndex::candidates(const QString& text) const
+{
+    QList<qint64> result;
+    const QSet<quint64> grams = trigrams(text);
+    if (grams.isEmpty() || isEmpty())
+        return result;
+
+    // intersect starting from the rarest trigram
+    QList<const QVector<qint64>*> lists;
+    foreach (quint64 gram, grams) {
+        QHash<quint64, QVector<qint64> >::const_iterator it = d.postings.constFind(gram);
+        if (it == d.postings.constEnd())
+            return result;
+        const QVector<qint64>* list = &it.value();
+        int i = 0;
+        while (i < lists.count() && lists.at(i)->count() < list->count())
+            ++i;
+        lists.insert(i, list);
+    }
+
+    const QVector<qint64>& rarest = *lists.first();
+    QVector<qint64>::const_iterator it = qLowerBound(rarest.constBegin(), rarest.constEnd(), d.first);
+    for (; it != rarest.constEnd(); ++it) {
+        bool all = true;
+        for (int i = 1; all && i < lists.count(); ++i)
+            all = qBinaryFind(lists.at(i)->constBegin(), lists.at(i)->constEnd(), *it) != lists.at(i)->constEnd();
+        if (all)
+            result += *it;
+    }
+    return result;
+}
+
+void SearchIndex::compact()
+{
+    QHash<quint64, QVector<qint64> >::iterator it = d.postings.begin();
+    while (it != d.postings.end()) {
+        QVector<qint64>& list = it.value();
+        list.erase(list.begin(), qLowerBound(list.begin(), list.end(), d.first));
+        if (list.isEmpty())
+            it = d.postings.erase(it);
+        else
+            ++it;
+    }
+    d.removed = 0;
+}
@@ -0,0 +1,273 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "styledtext.h"
+#include <QRegularExpression>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+
+// the inline markup produced by the formatters, anything else goes through insertHtml()
+static const char* const inlineTags[] = { "a", "b", "big", "code", "em", "font", "i", "s", "small", "span", "strong", "sub", "sup", "tt", "u", 0 };
+
+static bool isInline(const QString& name)
+{
+    for (int i = 0; inlineTags[i]; ++i) {
+        if (name == QLatin1String(inlineTags[i]))
+            return true;
+    }
+    return false;
+}
+
+static bool unescape(const QString& html, int from, int to, QString* text)
+{
+    int i = from;
+    while (i < to) {
+        const QChar c = html.at(i);
+        if (c != QLatin1Char('&')) {
+            *text += c;
+            ++i;
+            continue;
+        }
+
+        const int end = html.indexOf(QLatin1Char(';'), i);
+        if (end == -1 || end >= to || end - i > 10)
+            return false;
+
+        const QString entity = html.mid(i + 1, end - i - 1);
+        if (entity == QLatin1String("lt")) {
+            *text += QLatin1Char('<');
+        } else if (entity == QLatin1String("gt")) {
+            *text += QLatin1Char('>');
+        } else if (entity == QLatin1String("amp")) {
+            *text += QLatin1Char('&');
+        } else if (entity == QLatin1String("quot")) {
+            *text += QLatin1Char('"');
+        } else if (entity == QLatin1String("apos")) {
+            *text += QLatin1Char('\'');
+        } else if (entity == QLatin1String("nbsp")) {
+            *text += QChar(QChar::Nbsp);
+        } else if (entity.startsWith(QLatin1Char('#'))) {
+            bool ok = false;
+            uint code = 0;
+            if (entity.startsWith(QLatin1String("#x")) || entity.startsWith(QLatin1String("#X")))
+                code = entity.mid(2).toUInt(&ok, 16);
+            else
+                code = entity.mid(1).toUInt(&ok, 10);
+            if (!ok || !code)
+                return false;
+            *text += QString::fromUcs4(&code, 1);
+        } else {
+            return false;
+        }
+        i = end + 1;
+    }
+    return true;
+}
+
+static QString anchorOf(const QStringList& anchors)
+{
+    for (int i = anchors.count() - 1; i >= 0; --i) {
+        if (!anchors.at(i).isEmpty())
+            return anchors.at(i);
+    }
+    return QString();
+}
+
+bool StyledText::parse(const QString& html, QList<Run>* runs)
+{
+    static const QRegularExpression href("\\bhref\\s*=\\s*(?:'([^']*)'|\"([^\"]*)\")");
+
+    // the style of a run is the chain of tags it is nested in
+    QStringList tags;
+    QStringList anchors;
+    Run run;
+
+    int i = 0;
+    const int length = html.length();
+    while (i < length) {
+        int next = html.indexOf(QLatin1Char('<'), i);
+        if (next == -1)
+            next = length;
+        if (next > i && !unescape(html, i, next, &run.text))
+            return false;
+        if (next == length)
+            break;
+
+        const int end = html.indexOf(QLatin1Char('>'), next);
+        if (end == -1)
+            return false;
+        QString tag = html.mid(next + 1, end - next - 1).trimmed();
+        i = end + 1;
+
+        if (!run.text.isEmpty()) {
+            run.style = tags.join(QString());
+            run.anchor = anchorOf(anchors);
+            runs->append(run);
+            run.text.clear();
+        }
+
+        if (tag.startsWith(QLatin1Char('/'))) {
+            if (tags.isEmpty())
+                return false;
+            tags.removeLast();
+            anchors.removeLast();
+            continue;
+        }
+
+        if (tag.isEmpty() || tag.endsWith(QLatin1Char('/')))
+            return false;
+        int space = 0;
+        while (space < tag.length() && !tag.at(space).isSpace())
+            ++space;
+        const QString name = tag.left(space).toLower();
+        if (!isInline(name))
+            return false;
+
+        // links share one style, their targets are set per run
+        QString target;
+        if (name == QLatin1String("a")) {
+            const QRegularExpressionMatch match = href.match(tag);
+            if (match.hasMatch()) {
+                const int index = match.lastCapturedIndex();
+                if (!unescape(tag, match.capturedStart(index), match.capturedEnd(index), &target))
+                    return false;
+                tag.replace(match.capturedStart(), match.capturedLength(), QLatin1String("href='#'"));
+            }
+        }
+        tags += QLatin1Char('<') + tag + QLatin1Char('>');
+        anchors += target;
+    }
+
+    if (!run.text.isEmpty()) {
+        run.style = tags.join(QString());
+        run.anchor = anchorOf(anchors);
+        runs->append(run);
+    }
+    return true;
+}
+
+QString StyledText::styleSheet() const
+{
+    return d.css;
+}
+
+void StyledText::setStyleSheet(const QString& css)
+{
+    if (d.css != css) {
+        d.css = css;
+        d.styles.clear();
+    }
+}
+
+void StyledText::insert(QTextCursor& cursor, const QString& html)
+{
+    QList<Run> runs;
+    if (parse(html, &runs))
+        insert(cursor, runs);
+    else
+        cursor.insertHtml(html);
+}
+
+void StyledText::insert(QTextCursor& cursor, const QList<Run>& runs)
+{
+    bool space = cursor.atBlockStart();
+    foreach (const Run& run, runs) {
+        const Style style = resolve(run.style);
+
+        QString text;
+        if (style.preserve) {
+            text = run.text;
+            space = false;
+        } else {
+            // collapse white space the way the html import does
+            text.reserve(run.text.length());
+            foreach (const QChar& c, run.text) {
+                if (c == QLatin1Char(' ') || c == QLatin1Char('\t') || c == QLatin1Char('\n') || c == QLatin1Char('\r')) {
+                    if (!space)
+                        text += QLatin1Char(' ');
+                    space = true;
+                } else {
+                    text += c;
+                    space = false;
+                }
+            }
+        }
+
+        if (!text.isEmpty()) {
+            QTextCharFormat format = style.format;
+            if (!run.anchor.isEmpty())
+                format.setAnchorHref(run.anchor);
+            cursor.insertText(text, format);
+        }
+    }
+}
+
+StyledText::Style StyledText::resolve(const QString& style)
+{
+    if (!d.styles)
+        d.styles = styles(d.css);
+
+    Styles::const_iterator it = d.styles->constFind(style);
+    if (it != d.styles->constEnd())
+        return it.value();
+
+    // the html import runs once per distinct chain of tags
+    QTextDocument doc;
+    doc.setDefaultStyleSheet(d.css);
+    doc.setHtml(style + QLatin1String("x  x"));
+
+    Style result;
+    const QTextBlock block = doc.firstBlock();
+    if (!block.begin().atEnd())
+        result.format = block.begin().fragment().charFormat();
+    result.preserve = block.text() == QLatin1String("x  x");
+    d.styles->insert(style, result);
+    return result;
+}
+
+QSharedPointer<StyledText::Styles> StyledText::styles(const QString& css)
+{
+    // all documents with the same style sheet resolve into one cache,
+    // which goes away with the last of them
+    static QHash<QString, QWeakPointer<Styles> > sheets;
+
+    QSharedPointer<Styles> styles = sheets.value(css).toStrongRef();
+    if (!styles) {
+        styles = QSharedPointer<Styles>(new Styles);
+        sheets.insert(css, styles);
+
+        QHash<QString, QWeakPointer<Styles> >::iterator it = sheets.begin();
+        while (it != sheets.end()) {
+            if (it.value().isNull())
+                it = sheets.erase(it);
+            else
+                ++it;
+        }
+    }
+    return styles;
+}
@@ -0,0 +1,73 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef STYLEDTEXT_H
+#define STYLEDTEXT_H
+
+#include <QTextCharFormat>
+#include <QSharedPointer>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include "baseglobal.h"
+
+class QTextCursor;
+
+class BASE_EXPORT StyledText
+{
+public:
+    struct Run {
+        QString text;
+        QString style;
+        QString anchor;
+    };
+
+    static bool parse(const QString& html, QList<Run>* runs);
+
+    QString styleSheet() const;
+    void setStyleSheet(const QString& css);
+
+    void insert(QTextCursor& cursor, const QString& html);
+    void insert(QTextCursor& cursor, const QList<Run>& runs);
+
+private:
+    struct Style {
+        QTextCharFormat format;
+        bool preserve;
+    };
+    typedef QHash<QString, Style> Styles;
+
+    Style resolve(const QString& style);
+    static QSharedPointer<Styles> styles(const QString& css);
+
+    struct Private {
+        QString css;
+        QSharedPointer<Styles> styles;
+    } d;
+};
+
+#endif // STYLEDTEXT_H
@@ -47,6 +47,7 @@ TextBrowser::TextBrowser(QWidget* parent) : QTextBrowser(parent)
 {
     d.bud = 0;
     d.events = true;
+    d.fetch = false;
 
     setOpenLinks(false);
     setTabChangesFocus(true);
@@ -54,6 +55,8 @@ TextBrowser::TextBrowser(QWidget* parent) : QTextBrowser(parent)
     setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
     connect(this, SIGNAL(anchorClicked(QUrl)), this, SLOT(onAnchorClicked(QUrl)));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(requestHistory()));
+    connect(verticalScrollBar(), SIGNAL(rangeChanged(int,int)), this, SLOT(requestHistory()));
 }
 
 TextBrowser::~TextBrowser()
@@ -88,12 +91,15 @@ void TextBrowser::setDocument(TextDocument* document)
             doc->setVisible(false);
             disconnect(doc->documentLayout(), SIGNAL(documentSizeChanged(QSizeF)), this, SLOT(keepAtBottom()));
             disconnect(doc, SIGNAL(lineRemoved(int)), this, SLOT(keepPosition(int)));
+            disconnect(doc, SIGNAL(linesFetched(int)), this, SLOT(keepFetched(int)));
         }
         if (document) {
+            document->setVisibleLines(visibleLines());
             document->setVisible(true);
             document->setDefaultFont(font());
             connect(document->documentLayout(), SIGNAL(documentSizeChanged(QSizeF)), this, SLOT(keepAtBottom()));
             connect(document, SIGNAL(lineRemoved(int)), this, SLOT(keepPosition(int)));
+            connect(document, SIGNAL(linesFetched(int)), this, SLOT(keepFetched(int)));
         }
         connect(this, SIGNAL(textChanged()), this, SLOT(moveCursorToBottom()));
         QTextBrowser::setDocument(document);
@@ -117,8 +123,10 @@ void TextBrowser::mousePressEvent(QMouseEvent* event)
 {
     const QUrl url(anchorAt(event->pos()));
     if (url.scheme() == "expand") {
+        // collapsed replies expand in place, merged events show in a tooltip
         QString text;
-        if (TextDocument* doc = document()) {
+        TextDocument* doc = document();
+        if (doc && !doc->expand(cursorForPosition(event->pos()).blockNumber())) {
             const QPoint offset(horizontalScrollBar()->value(), verticalScrollBar()->value());
             text = doc->tooltip(event->pos() + offset);
         }
@@ -170,6 +178,9 @@ void TextBrowser::resizeEvent(QResizeEvent* event)
 {
     QTextBrowser::resizeEvent(event);
 
+    if (TextDocument* doc = document())
+        doc->setVisibleLines(visibleLines());
+
     // http://www.qtsoftware.com/developer/task-tracker/index_html?method=entry&id=240940
     QMetaObject::invokeMethod(this, "scrollToBottom", Qt::QueuedConnection);
 }
@@ -310,6 +321,10 @@ void TextBrowser::wheelEvent(QWheelEvent* event)
 #else
     QTextBrowser::wheelEvent(event);
 #endif // Q_OS_MAC
+
+    // the scroll bar does not move any further up at the top
+    if (event->angleDelta().y() > 0)
+        requestHistory();
 }
 
 void TextBrowser::keepAtBottom()
@@ -324,6 +339,44 @@ void TextBrowser::keepPosition(int delta)
         verticalScrollBar()->setValue(verticalScrollBar()->value() - delta);
 }
 
+void TextBrowser::requestHistory()
+{
+    // deferred, so that the scroll bar is not moved from within its own signals
+    TextDocument* doc = document();
+    if (!d.fetch && doc && isAtTop() && doc->canFetchMore()) {
+        d.fetch = true;
+        QMetaObject::invokeMethod(this, "fetchHistory", Qt::QueuedConnection);
+    }
+}
+
+void TextBrowser::fetchHistory()
+{
+    d.fetch = false;
+    TextDocument* doc = document();
+    if (doc && isAtTop())
+        doc->fetchMore();
+}
+
+void TextBrowser::keepFetched(int count)
+{
+    // keep the line that was at the top in place
+    TextDocument* doc = document();
+    if (doc && count > 0) {
+        const QTextBlock block = doc->findBlockByNumber(count);
+        if (block.isValid())
+            verticalScrollBar()->setValue(verticalScrollBar()->value() + qRound(doc->documentLayout()->blockBoundingRect(block).top()));
+    }
+
+    // content shorter than the view cannot be scrolled, so it asks until the view fills up
+    requestHistory();
+}
+
+int TextBrowser::visibleLines() const
+{
+    // every line takes at least one row
+    return viewport()->height() / qMax(1, fontMetrics().lineSpacing());
+}
+
 void TextBrowser::moveCursorToBottom()
 {
     QTextCursor cursor = textCursor();
@@ -81,14 +81,20 @@ protected:
 private slots:
     void keepAtBottom();
     void keepPosition(int delta);
+    void requestHistory();
+    void fetchHistory();
+    void keepFetched(int count);
     void onAnchorClicked(const QUrl& url);
 
     void onWhoisTriggered();
     void onQueryTriggered();
 
 private:
+    int visibleLines() const;
+
     struct Private {
         bool events;
+        bool fetch;
         QWidget* bud;
     } d;
 };
@@ -28,14 +28,23 @@
 
 #include "textdocument.h"
 #include "eventformatter.h"
+#include "flushscheduler.h"
+#include "formatpipeline.h"
 #include <QAbstractTextDocumentLayout>
 #include <QTextDocumentFragment>
 #include <QTextBlockUserData>
+#include <QStandardPaths>
+#include <QTemporaryFile>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QRunnable>
 #include <IrcConnection>
 #include <QStylePainter>
+#include <QElapsedTimer>
 #include <QApplication>
 #include <QStyleOption>
 #include <QTextCursor>
+#include <QDataStream>
 #include <QTextBlock>
 #include <IrcMessage>
 #include <IrcBuffer>
@@ -43,9 +52,37 @@
 #include <QPointer>
 #include <QPainter>
 #include <QFrame>
+#include <QMap>
+#include <QSet>
+#include <QDir>
 #include <qmath.h>
+#include <limits>
 
-static int delay = 1000;
+// hidden documents that still have their blocks laid out, most recent first
+static QList<TextDocument*> recent;
+static const int maximumRecent = 10;
+
+// reads of spilled lines report back only to a document that is still alive
+static QMutex documentMutex;
+static QSet<TextDocument*> documents;
+
+// how many held or spilled lines are paged back in at a time
+static const int fetchCount = 100;
+
+// how many spilled lines a search reads back at most
+static const int searchCount = 5000;
+
+// marks the characters of a block that make up its time stamp
+static const int TimeStampProperty = QTextFormat::UserProperty + 1;
+
+// how many lines a rebuild lays out between checks of its time budget
+static const int sliceCount = 50;
+
+// what is left to do for an announced message once its line comes in
+enum Pending {
+    PendingUnread = 0x1,
+    PendingHighlight = 0x2
+};
 
 class TextFrame : public QFrame
 {
@@ -86,28 +123,312 @@ struct TextBlockMessageData : QTextBlockUserData
     MessageData data;
 };
 
+// the text a line is searched by, including what a collapsed reply holds
+static QString searchText(const QTextBlock& block)
+{
+    QString text = block.text();
+    TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
+    if (blockData && blockData->data.isCollapsed())
+        text += QLatin1Char(' ') + blockData->data.fields().join(QLatin1Char(' '));
+    text.replace(QChar::Nbsp, QLatin1Char(' '));
+    return text;
+}
+
+// the same text for a line that is not laid out, so that it can be searched on a worker too
+static QString lineText(const MessageData& data, const QString& timeFormat)
+{
+    QList<StyledText::Run> runs = data.runs();
+    if (runs.isEmpty() && !StyledText::parse(data.format(), &runs))
+        return QString();
+
+    QString text = data.timestamp().time().toString(timeFormat) + QLatin1Char(' ');
+    foreach (const StyledText::Run& run, runs)
+        text += run.text;
+    if (data.isCollapsed())
+        text += QLatin1Char(' ') + data.fields().join(QLatin1Char(' '));
+    text.replace(QChar::Nbsp, QLatin1Char(' '));
+    return text;
+}
+
+static MessageData dateChange(const QDate& date)
+{
+    MessageData dc;
+    dc.setFormat(QString("<span class='date'>%1</span>").arg(date.toString(Qt::ISODate)));
+    return dc;
+}
+
+// an append-only file of evicted lines, shared by a document and its clones.
+// each record is framed by its size on both ends so it can be read backwards.
+// records are written behind on a worker thread and read back on one too,
+// and both hold on to the file until they are done with it.
+class ScrollbackFile
+{
+public:
+    static QSharedPointer<ScrollbackFile> create()
+    {
+        QSharedPointer<ScrollbackFile> file(new ScrollbackFile);
+        file->self = file;
+        return file;
+    }
+
+    qint64 size() const
+    {
+        return length;
+    }
+
+    void append(const MessageData& line, bool highlighted)
+    {
+        QByteArray record;
+        QDataStream out(&record, QIODevice::WriteOnly);
+        out << highlighted << line;
+
+        QByteArray frame;
+        QDataStream stream(&frame, QIODevice::WriteOnly);
+        stream << quint32(record.size());
+        stream.writeRawData(record.constData(), record.size());
+        stream << quint32(record.size());
+
+        // lines lately written are stepped past by the rest of the family from here
+        ends.insert(length, length + frame.size());
+        while (ends.count() > maximumEnds)
+            ends.erase(ends.begin());
+        length += frame.size();
+
+        QMutexLocker locker(&mutex);
+        pending += frame;
+        if (!writing) {
+            writing = true;
+            QThreadPool::globalInstance()->start(new ScrollbackWriter(self.toStrongRef()));
+        }
+    }
+
+    qint64 skip(qint64 offset)
+    {
+        QMap<qint64, qint64>::const_iterator it = ends.constFind(offset);
+        if (it != ends.constEnd())
+            return it.value();
+
+        quint32 size = 0;
+        QMutexLocker locker(&io);
+        writePending();
+        if (file.isOpen() && file.seek(offset)) {
+            QDataStream stream(&file);
+            stream >> size;
+        }
+        return offset + size + 2 * sizeof(quint32);
+    }
+
+    bool read(qint64* offset, MessageData* line, bool* highlighted)
+    {
+        QMutexLocker locker(&io);
+        writePending();
+
+        quint32 size = 0;
+        if (*offset < qint64(2 * sizeof(quint32)) || !file.isOpen() || !file.seek(*offset - sizeof(quint32)))
+            return false;
+        QDataStream stream(&file);
+        stream >> size;
+
+        const qint64 start = *offset - size - 2 * sizeof(quint32);
+        if (start < 0 || !file.seek(start + sizeof(quint32)))
+            return false;
+
+        QDataStream in(file.read(size));
+        in >> *highlighted >> *line;
+        *offset = start;
+        return in.status() == QDataStream::Ok;
+    }
+
+    void write()
+    {
+        forever {
+            {
+                QMutexLocker locker(&io);
+                if (writePending())
+                    continue;
+            }
+            QMutexLocker state(&mutex);
+            if (pending.isEmpty()) {
+                writing = false;
+                return;
+            }
+        }
+    }
+
+private:
+    ScrollbackFile() : length(0), writing(false)
+    {
+        QDir dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+        if (dir.mkpath("scrollback"))
+            file.setFileTemplate(dir.filePath("scrollback/XXXXXX"));
+    }
+
+    class ScrollbackWriter : public QRunnable
+    {
+    public:
+        ScrollbackWriter(const QSharedPointer<ScrollbackFile>& file) : file(file) { }
+        void run() { file->write(); }
+    private:
+        QSharedPointer<ScrollbackFile> file;
+    };
+
+    // with the io lock held, so that the bytes go out in the order they came in
+    bool writePending()
+    {
+        QByteArray bytes;
+        {
+            QMutexLocker locker(&mutex);
+            bytes.swap(pending);
+        }
+        if (bytes.isEmpty())
+            return false;
+        if (file.isOpen() || file.open()) {
+            file.seek(file.size());
+            file.write(bytes);
+        }
+        return true;
+    }
+
+    static const int maximumEnds = 4096;
+
+    qint64 length;
+    QMap<qint64, qint64> ends;
+
+    QMutex io;
+    QTemporaryFile file;
+
+    QMutex mutex;
+    bool writing;
+    QByteArray pending;
+    QWeakPointer<ScrollbackFile> self;
+};
+
+// reads spilled lines back on a worker thread, for a document that is still around.
+// a search reads on until the newest line that matches, and brings back the lines
+// from there on, or nothing if no line within reach matches.
+class ScrollbackReader : public QRunnable
+{
+public:
+    ScrollbackReader(TextDocument* document, const QSharedPointer<ScrollbackFile>& file, qint64 offset,
+                     const QString& text = QString(), const QString& timeFormat = QString())
+        : document(document), file(file), offset(offset), text(text), timeFormat(timeFormat) { }
+
+    void run()
+    {
+        QList<MessageData> older;
+        QList<int> lights;
+        MessageData record;
+        bool highlighted = false;
+        bool found = text.isEmpty();
+        qint64 position = offset;
+        while (older.count() < (found ? fetchCount : searchCount) && file->read(&position, &record, &highlighted)) {
+            if (highlighted)
+                lights.prepend(older.count());
+            older.prepend(record);
+            if (!found && lineText(record, timeFormat).contains(text, Qt::CaseInsensitive)) {
+                found = true;
+                break;
+            }
+        }
+
+        QMutexLocker locker(&documentMutex);
+        if (!documents.contains(document))
+            return;
+        if (found)
+            QMetaObject::invokeMethod(document, "fetched", Qt::QueuedConnection,
+                                      Q_ARG(qint64, offset), Q_ARG(qint64, position),
+                                      Q_ARG(QList<MessageData>, older), Q_ARG(QList<int>, lights));
+        else
+            QMetaObject::invokeMethod(document, "missed", Qt::QueuedConnection);
+    }
+
+private:
+    TextDocument* document;
+    QSharedPointer<ScrollbackFile> file;
+    qint64 offset;
+    QString text;
+    QString timeFormat;
+};
+
 TextDocument::TextDocument(IrcBuffer* buffer) : QTextDocument(buffer)
+{
+    init(buffer);
+
+    d.formatter = new MessageFormatter(this);
+    d.formatter->setBuffer(buffer);
+    d.pipeline = new FormatPipeline(d.formatter, this);
+    connect(d.pipeline, SIGNAL(formatted(IrcMessage*,MessageData)), this, SLOT(deliver(IrcMessage*,MessageData)));
+    connect(d.pipeline, SIGNAL(submitted(int,IrcMessage*)), this, SLOT(announce(int,IrcMessage*)));
+    connect(d.pipeline, SIGNAL(completed(int,MessageData)), this, SLOT(complete(int,MessageData)));
+    connect(d.pipeline, SIGNAL(drained()), this, SLOT(endBatches()));
+    d.scrollback = ScrollbackFile::create();
+
+    connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(receiveMessage(IrcMessage*)));
+}
+
+TextDocument::TextDocument(TextDocument* source) : QTextDocument(source->buffer())
+{
+    init(source->buffer());
+
+    // clones share the formatted messages of the original document
+    d.clone = true;
+    d.source = source;
+    d.formatter = source->formatter();
+    source->d.clones += this;
+}
+
+TextDocument::~TextDocument()
+{
+    {
+        QMutexLocker locker(&documentMutex);
+        documents.remove(this);
+    }
+    if (d.source)
+        d.source->d.clones.removeOne(this);
+    recent.removeOne(this);
+    FlushScheduler::instance()->cancel(this);
+}
+
+void TextDocument::init(IrcBuffer* buffer)
 {
     qRegisterMetaType<TextDocument*>();
+    qRegisterMetaType<QList<MessageData> >();
+    qRegisterMetaType<QList<int> >();
+
+    {
+        QMutexLocker locker(&documentMutex);
+        documents.insert(this);
+    }
 
     d.scrollbackMarkerPosition = -1;
-    d.dirty = -1;
     d.rebuild = -1;
+    d.rebuilding = false;
+    d.stamped = true;
+    d.maximum = 1000;
+    d.window = 0;
+    d.expanded = 0;
+    d.paged = 0;
+    d.spilled = 0;
+    d.fetching = false;
     d.lowlight = -1;
+    d.sequence = 0;
+    d.seen = std::numeric_limits<qint64>::min();
+    d.unread = 0;
+    d.unreadHighlights = 0;
+    d.ahead = 0;
     d.clone = false;
     d.batch = false;
+    d.batched = false;
+    d.loaded = false;
     d.buffer = buffer;
     d.visible = false;
-
-    d.formatter = new MessageFormatter(this);
-    connect(d.formatter, SIGNAL(formatted(MessageData)), this, SLOT(append(MessageData)));
-    d.formatter->setBuffer(buffer);
+    d.formatter = 0;
+    d.pipeline = 0;
 
     setUndoRedoEnabled(false);
-    setMaximumBlockCount(1000);
+    setMaximumBlockCount(d.maximum);
 
     connect(buffer->connection(), SIGNAL(disconnected()), this, SLOT(lowlight()));
-    connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(receiveMessage(IrcMessage*)));
 }
 
 QString TextDocument::timeStampFormat() const
@@ -118,8 +439,16 @@ QString TextDocument::timeStampFormat() const
 void TextDocument::setTimeStampFormat(const QString& format)
 {
     if (d.timeStampFormat != format) {
+        // without a time stamp run there is nothing to rewrite in place
+        const bool reflow = d.timeStampFormat.isEmpty() || format.isEmpty();
         d.timeStampFormat = format;
-        scheduleRebuild();
+        d.index.clear();
+        if (reflow)
+            scheduleRebuild();
+        else if (d.visible)
+            updateTimeStamps();
+        else if (d.loaded)
+            d.stamped = false;
     }
 }
 
@@ -132,6 +461,7 @@ void TextDocument::setStyleSheet(const QString& css)
 {
     if (d.css != css) {
         d.css = css;
+        d.styled.setStyleSheet(css);
         setDefaultStyleSheet(css);
         scheduleRebuild();
     }
@@ -139,22 +469,32 @@ void TextDocument::setStyleSheet(const QString& css)
 
 TextDocument* TextDocument::clone()
 {
-    if (d.dirty > 0)
-        flush();
-
-    TextDocument* doc = new TextDocument(d.buffer);
+    TextDocument* doc = new TextDocument(d.source ? d.source.data() : this);
     doc->setDefaultStyleSheet(defaultStyleSheet());
-    QTextCursor(doc).insertFragment(QTextDocumentFragment(this));
     doc->rootFrame()->setFrameFormat(rootFrame()->frameFormat());
 
+    // the clone lays out its own blocks once it becomes visible
+    doc->d.queue = lines();
+    doc->d.maximum = d.maximum;
+    doc->d.window = d.window;
+    doc->d.paged = d.paged;
+    doc->d.spilled = d.spilled;
+    doc->d.scrollback = d.scrollback;
+    doc->setMaximumBlockCount(maximumBlockCount());
+
     // TODO:
     doc->d.scrollbackMarkerPosition = d.scrollbackMarkerPosition;
     doc->d.css = d.css;
+    doc->d.styled = d.styled;
     doc->d.lowlight = d.lowlight;
     doc->d.buffer = d.buffer;
     doc->d.highlights = d.highlights;
+    doc->d.sequence = d.sequence - d.held.count();
+    doc->d.latestMessageSeen = d.latestMessageSeen;
+    doc->d.seen = d.seen;
+    doc->d.unread = d.unread;
+    doc->d.unreadHighlights = d.unreadHighlights;
     doc->d.timeStampFormat = d.timeStampFormat;
-    doc->d.clone = true;
 
     return doc;
 }
@@ -182,6 +522,244 @@ int TextDocument::totalCount() const
     return count;
 }
 
+int TextDocument::maximumLineCount() const
+{
+    return d.maximum;
+}
+
+void TextDocument::setMaximumLineCount(int count)
+{
+    count = qMax(1, count);
+    if (d.maximum != count) {
+        d.maximum = count;
+
+        // let trim() spill whatever no longer fits
+        requeue();
+        d.paged = 0;
+        setMaximumBlockCount(capacity());
+        trim();
+        if (d.loaded)
+            flush();
+    }
+}
+
+int TextDocument::visibleLines() const
+{
+    return d.window / 2;
+}
+
+void TextDocument::setVisibleLines(int count)
+{
+    // a visible document lays out what its view shows plus a screenful
+    // above, and holds the older lines as plain message data
+    const int window = count > 0 ? qMax(fetchCount, 2 * count) : 0;
+    if (d.window != window) {
+        // a smaller window takes effect when the blocks are laid out again
+        d.window = window;
+        if (d.loaded && capacity() > maximumBlockCount())
+            setMaximumBlockCount(capacity());
+    }
+}
+
+bool TextDocument::canFetchMore() const
+{
+    return !d.held.isEmpty() || (d.scrollback && d.spilled > 0);
+}
+
+void TextDocument::fetchMore()
+{
+    if (!canFetchMore())
+        return;
+
+    flush();
+
+    if (!d.held.isEmpty()) {
+        // held lines still have their numbers, highlights and counts
+        const int count = qMin(fetchCount, d.held.count());
+        const QList<MessageData> older = d.held.mid(d.held.count() - count);
+        d.held.erase(d.held.end() - count, d.held.end());
+        d.sequence -= count;
+        layoutOlder(older);
+    } else if (!d.fetching) {
+        // spilled lines are read on a worker and come back to fetched()
+        d.fetching = true;
+        QThreadPool::globalInstance()->start(new ScrollbackReader(this, d.scrollback, d.spilled));
+    }
+}
+
+void TextDocument::fetched(qint64 from, qint64 to, const QList<MessageData>& older, const QList<int>& lights)
+{
+    d.fetching = false;
+    flush();
+    if (!d.scrollback || d.spilled != from) {
+        // lines spilled in the meanwhile moved the cursor, the view asks again
+        emit linesFetched(0);
+        return;
+    }
+
+    // nothing more can be read from a file that ends short
+    const int count = older.count();
+    d.spilled = count > 0 ? to : 0;
+    if (!count) {
+        emit linesFetched(0);
+        return;
+    }
+
+    // numbered below the held lines, if a search read past them
+    const qint64 first = d.sequence - d.held.count() - count;
+    for (int i = 0; i < lights.count(); ++i)
+        d.highlights.insert(i, first + count - 1 - lights.at(i));
+
+    for (int i = 0; i < count; ++i) {
+        if (isUnread(older.at(i))) {
+            ++d.unread;
+            if (isHighlighted(first + i))
+                ++d.unreadHighlights;
+        }
+    }
+
+    d.paged += count;
+    d.sequence = first;
+    const QList<MessageData> held = d.held;
+    d.held.clear();
+    layoutOlder(older + held);
+}
+
+void TextDocument::missed()
+{
+    d.fetching = false;
+    emit linesFetched(0);
+}
+
+void TextDocument::restore(const QList<MessageData>& history)
+{
+    if (d.clone) {
+        if (d.source)
+            d.source->restore(history);
+        return;
+    }
+    foreach (TextDocument* doc, family())
+        doc->prepend(history);
+}
+
+QList<int> TextDocument::search(const QString& text)
+{
+    // only the laid out lines, older ones are looked up by findOlder()
+    QList<int> numbers;
+    if (text.isEmpty() || isEmpty())
+        return numbers;
+
+    const int count = blockCount();
+    QList<int> candidates;
+    if (text.length() < SearchIndex::minimumLength()) {
+        for (int i = 0; i < count; ++i)
+            candidates += i;
+    } else {
+        updateIndex();
+        foreach (qint64 sequence, d.index.candidates(text)) {
+            const qint64 number = sequence - d.sequence;
+            if (number >= 0 && number < count - 1)
+                candidates += int(number);
+        }
+        candidates += count - 1;
+    }
+
+    foreach (int number, candidates) {
+        // a reply that matches within is expanded once navigated to
+        if (searchText(findBlockByNumber(number)).contains(text, Qt::CaseInsensitive))
+            numbers += number;
+    }
+    return numbers;
+}
+
+bool TextDocument::findOlder(const QString& text)
+{
+    if (text.isEmpty() || !d.loaded || d.fetching)
+        return false;
+
+    flush();
+
+    // the newest held line that matches is laid out along with the
+    // lines after it, and a search reads on into the scrollback file
+    const qint64 oldest = d.sequence - d.held.count();
+    qint64 match = -1;
+    if (text.length() < SearchIndex::minimumLength()) {
+        for (qint64 sequence = d.sequence - 1; match == -1 && sequence >= oldest; --sequence) {
+            if (lineText(d.held.at(sequence - oldest), d.timeStampFormat).contains(text, Qt::CaseInsensitive))
+                match = sequence;
+        }
+    } else if (!d.held.isEmpty()) {
+        updateIndex();
+        const QList<qint64> candidates = d.index.candidates(text);
+        QList<qint64>::const_iterator it = qLowerBound(candidates.constBegin(), candidates.constEnd(), d.sequence);
+        while (match == -1 && it != candidates.constBegin()) {
+            --it;
+            if (*it < oldest)
+                break;
+            if (lineText(d.held.at(*it - oldest), d.timeStampFormat).contains(text, Qt::CaseInsensitive))
+                match = *it;
+        }
+    }
+
+    if (match != -1) {
+        const int count = int(d.sequence - match);
+        const QList<MessageData> older = d.held.mid(d.held.count() - count);
+        d.held.erase(d.held.end() - count, d.held.end());
+        d.sequence -= count;
+        layoutOlder(older);
+        return true;
+    }
+
+    if (!d.scrollback || d.spilled <= 0)
+        return false;
+
+    d.fetching = true;
+    QThreadPool::globalInstance()->start(new ScrollbackReader(this, d.scrollback, d.spilled, text, d.timeStampFormat));
+    return true;
+}
+
+LineFilter TextDocument::filter() const
+{
+    return d.filter;
+}
+
+int TextDocument::applyFilter(const QString& query)
+{
+    // lines laid out later are filtered as they come in
+    d.filter = LineFilter(query);
+
+    QList<int> matches;
+    const bool text = !d.filter.text().isEmpty();
+    if (text)
+        matches = search(d.filter.text());
+    QList<int>::const_iterator match = matches.constBegin();
+
+    int count = 0;
+    bool changed = false;
+    for (QTextBlock block = begin(); block.isValid(); block = block.next()) {
+        bool visible = true;
+        if (!d.filter.isEmpty()) {
+            const int number = block.blockNumber();
+            while (match != matches.constEnd() && *match < number)
+                ++match;
+            TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
+            visible = blockData && (!text || (match != matches.constEnd() && *match == number))
+                      && d.filter.matches(blockData->data, isHighlighted(d.sequence + number));
+        }
+        if (visible)
+            ++count;
+        if (block.isVisible() != visible) {
+            block.setVisible(visible);
+            changed = true;
+        }
+    }
+
+    // a single relayout instead of one per block
+    if (changed)
+        markContentsDirty(0, characterCount());
+    return count;
+}
+
 bool TextDocument::isVisible() const
 {
     return d.visible;
@@ -193,8 +771,10 @@ void TextDocument::setVisible(bool visible)
         return;
 
     if (visible) {
-        if (d.dirty > 0)
-            flush();
+        recent.removeOne(this);
+        flush();
+        if (!d.stamped)
+            updateTimeStamps();
 
         // Update scroll marker position before updating seen message timestamp
         if (latestMessageReceived() > latestMessageSeen()) {
@@ -202,10 +782,10 @@ void TextDocument::setVisible(bool visible)
             QTextBlock block = lastBlock();
             while (block.isValid()) {
                 TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
-                if (blockData && blockData->data.timestamp() <= latestMessageSeen())
+                if (blockData && blockData->data.hasTimestamp() && blockData->data.timestampMSecs() <= d.seen)
                     break;
 
-                d.scrollbackMarkerPosition = block.blockNumber();
+                d.scrollbackMarkerPosition = d.sequence + block.blockNumber();
                 block = block.previous();
             }
         }
@@ -213,6 +793,10 @@ void TextDocument::setVisible(bool visible)
         setLatestMessageSeen(latestMessageReceived());
     } else {
         d.scrollbackMarkerPosition = -1;
+
+        recent.prepend(this);
+        while (recent.count() > maximumRecent)
+            recent.takeLast()->unload();
     }
 
     d.visible = visible;
@@ -245,52 +829,32 @@ void TextDocument::setLatestMessageSeen(const QDateTime& timestamp)
         return;
 
     d.latestMessageSeen = timestamp;
+    d.seen = timestamp.isValid() ? timestamp.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+    if (timestamp >= latestMessageReceived()) {
+        d.unread = 0;
+        d.unreadHighlights = 0;
+    } else {
+        recount();
+    }
     emit latestMessageSeenChanged(timestamp);
 }
 
 int TextDocument::unreadMessages() const
 {
-    int unread = 0;
-
-    // Note: The following logic assumes the queue and blocks are ordered by time
-
-    QListIterator<MessageData> iterator(d.queue);
-    iterator.toBack();
-    while (iterator.hasPrevious()) {
-        MessageData message = iterator.previous();
-        if (message.timestamp() <= d.latestMessageSeen)
-            return unread;
-
-        if (message.type() != IrcMessage::Private && message.type() != IrcMessage::Notice)
-            continue;
-
-        ++unread;
-    }
-
-    for (QTextBlock block = lastBlock(); block.isValid(); block = block.previous()) {
-        TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
-        if (!blockData)
-            continue;
-
-        MessageData message = blockData->data;
-        if (message.timestamp() <= d.latestMessageSeen)
-            break;
-
-        if (message.type() != IrcMessage::Private && message.type() != IrcMessage::Notice)
-            continue;
-
-        ++unread;
-    }
+    return d.unread + d.ahead;
+}
 
-    return unread;
+int TextDocument::unreadHighlights() const
+{
+    return d.unreadHighlights;
 }
 
 void TextDocument::lowlight(int block)
 {
     if (block == -1)
         block = totalCount() - 1;
-    if (d.lowlight != block) {
-        d.lowlight = block;
+    if (d.lowlight != d.sequence + block) {
+        d.lowlight = d.sequence + block;
         updateBlock(block);
     }
 }
@@ -301,24 +865,49 @@ void TextDocument::addHighlight(int block)
     if (block == -1)
         block = max;
     if (block >= 0 && block <= max) {
-        QList<int>::iterator it = qLowerBound(d.highlights.begin(), d.highlights.end(), block);
-        d.highlights.insert(it, block);
+        const qint64 sequence = d.sequence + block;
+        QList<qint64>::iterator it = qLowerBound(d.highlights.begin(), d.highlights.end(), sequence);
+        d.highlights.insert(it, sequence);
+        if (isUnread(line(block)))
+            ++d.unreadHighlights;
+        if (!d.filter.isEmpty()) {
+            QTextBlock textBlock = findBlockByNumber(block);
+            if (textBlock.isValid() && !textBlock.isVisible() && passesFilter(textBlock)) {
+                textBlock.setVisible(true);
+                markContentsDirty(textBlock.position(), textBlock.length());
+            }
+        }
         updateBlock(block);
     }
 }
 
 void TextDocument::removeHighlight(int block)
 {
-    if (d.highlights.removeOne(block) && block >= 0 && block < totalCount())
+    if (d.highlights.removeOne(d.sequence + block) && block >= 0 && block < totalCount()) {
+        if (isUnread(line(block)))
+            --d.unreadHighlights;
         updateBlock(block);
+    }
 }
 
 void TextDocument::reset()
 {
     d.scrollbackMarkerPosition = -1;
     d.lowlight = -1;
+    d.unread = 0;
+    d.unreadHighlights = 0;
     d.highlights.clear();
     d.queue.clear();
+    d.held.clear();
+    // the blocks that come next are numbered from where the cleared ones were
+    d.index.clear();
+
+    // a cleared document has no history to page back in
+    d.scrollback.clear();
+    d.spilled = 0;
+    d.paged = 0;
+    d.expanded = 0;
+    setMaximumBlockCount(capacity());
 }
 
 void TextDocument::append(const MessageData& data)
@@ -330,11 +919,8 @@ void TextDocument::append(const MessageData& data)
         else if (TextBlockMessageData* block = static_cast<TextBlockMessageData*>(lastBlock().userData()))
             last = block->data;
 
-        if (!last.isEmpty() && data.type() != IrcMessage::Unknown && data.timestamp().date() != last.timestamp().date()) {
-            MessageData dc;
-            dc.setFormat(QString("<p class='date'>%1</p>").arg(data.timestamp().date().toString(Qt::ISODate)));
-            append(dc);
-        }
+        if (!last.isEmpty() && data.type() != IrcMessage::Unknown && data.timestamp().date() != last.timestamp().date())
+            append(dateChange(data.timestamp().date()));
 
         MessageData msg = data;
         const bool merge = last.canMerge(data);
@@ -343,8 +929,12 @@ void TextDocument::append(const MessageData& data)
             msg.setFormat(formatSummary(msg.getEvents()));
             if (!d.queue.isEmpty())
                 d.queue.replace(d.queue.count() - 1, msg);
+        } else if (isUnread(msg)) {
+            ++d.unread;
         }
-        if (!d.batch && (d.dirty == 0 || d.visible)) {
+        // visible documents take lines right away, the rest are queued for
+        // the flush scheduler; merges into a laid out line are done in place
+        if (d.loaded && d.queue.isEmpty() && (merge || (!d.batch && d.visible))) {
             QTextCursor cursor(this);
             cursor.beginEditBlock();
             if (merge) {
@@ -356,22 +946,22 @@ void TextDocument::append(const MessageData& data)
             insert(cursor, msg);
             cursor.endEditBlock();
         } else {
-            if (!d.batch && d.dirty <= 0) {
-                d.dirty = startTimer(delay);
-                delay += 1000;
-            }
             if (!merge)
                 d.queue += msg;
+            if (!d.loaded)
+                trim();
+            else if (!d.batch && !d.rebuilding)
+                FlushScheduler::instance()->schedule(this);
         }
     }
 }
 
 void TextDocument::drawForeground(QPainter* painter, const QRect& bounds)
 {
-    if (d.scrollbackMarkerPosition <= 0)
+    if (d.scrollbackMarkerPosition == -1 || d.scrollbackMarkerPosition <= d.sequence)
         return;
 
-    QTextBlock block = findBlockByNumber(d.scrollbackMarkerPosition);
+    QTextBlock block = findBlockByNumber(d.scrollbackMarkerPosition - d.sequence);
     if (!block.isValid())
         return;
 
@@ -408,10 +998,8 @@ void TextDocument::drawBackground(QPainter* painter, const QRect& bounds)
     if (!highlightFrame)
         highlightFrame = new TextHighlight(static_cast<QWidget*>(painter->device()));
 
-    if (d.lowlight != -1) {
-        const QAbstractTextDocumentLayout* layout = documentLayout();
-        const int margin = qCeil(documentMargin());
-        const QTextBlock to = findBlockByNumber(d.lowlight);
+    if (d.lowlight >= d.sequence) {
+        const QTextBlock to = findBlockByNumber(d.lowlight - d.sequence);
         if (to.isValid()) {
             QRect br = layout->blockBoundingRect(to).toAlignedRect();
             br.setTop(0);
@@ -425,8 +1013,21 @@ void TextDocument::drawBackground(QPainter* painter, const QRect& bounds)
         }
     }
 
-    foreach (int highlight, d.highlights) {
-        QTextBlock block = findBlockByNumber(highlight);
+    if (d.highlights.isEmpty())
+        return;
+
+    // only the highlights within the visible range of blocks are painted
+    const QTextBlock first = findBlock(layout->hitTest(bounds.topLeft(), Qt::FuzzyHit));
+    QTextBlock last = findBlock(layout->hitTest(bounds.bottomLeft(), Qt::FuzzyHit));
+    if (!first.isValid())
+        return;
+    if (!last.isValid())
+        last = lastBlock();
+
+    const qint64 to = d.sequence + last.blockNumber();
+    QList<qint64>::const_iterator it = qLowerBound(d.highlights.constBegin(), d.highlights.constEnd(), d.sequence + first.blockNumber());
+    for (; it != d.highlights.constEnd() && *it <= to; ++it) {
+        QTextBlock block = findBlockByNumber(*it - d.sequence);
         if (block.isValid()) {
             QRect br = layout->blockBoundingRect(block).toAlignedRect();
             if (bounds.intersects(br)) {
@@ -450,6 +1051,29 @@ QString TextDocument::tooltip(const QPoint& point) const
     return QString();
 }
 
+bool TextDocument::expand(int number)
+{
+    QTextBlock block = findBlockByNumber(number);
+    TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
+    if (!blockData || !blockData->data.isCollapsed())
+        return false;
+
+    // the reply takes the place of its summary, within the same block
+    // so that the numbering of the lines stays the same
+    MessageData data = blockData->data;
+    data.setFormat(d.formatter->formatReply(data).join(QStringLiteral("<br/>")));
+    data.setData(QByteArray());
+
+    QTextCursor cursor(block);
+    cursor.beginEditBlock();
+    cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+    insertLine(cursor, data);
+    setupBlock(cursor, data);
+    cursor.endEditBlock();
+    return true;
+}
+
 void TextDocument::updateBlock(int number)
 {
     if (d.visible) {
@@ -462,125 +1086,382 @@ void TextDocument::updateBlock(int number)
 void TextDocument::timerEvent(QTimerEvent* event)
 {
     QTextDocument::timerEvent(event);
-    if (event->timerId() == d.dirty) {
-        delay -= 1000;
-        flush();
-    } else if (event->timerId() == d.rebuild) {
+    if (event->timerId() == d.rebuild) {
         rebuild();
     }
 }
 
 void TextDocument::flush()
 {
+    // loaded first, so that the lines beyond the window are held rather than spilled
+    d.loaded = true;
     if (!d.queue.isEmpty()) {
         QTextCursor cursor(this);
         cursor.beginEditBlock();
-        foreach (const MessageData& data, d.queue)
-            insert(cursor, data);
+        insertQueue(cursor, d.queue.count());
         cursor.endEditBlock();
-        d.queue.clear();
     }
 
-    if (d.dirty > 0) {
-        killTimer(d.dirty);
-        d.dirty = 0;
-    }
+    FlushScheduler::instance()->cancel(this);
 }
 
 void TextDocument::receiveMessage(IrcMessage* message)
 {
+    // each message is formatted once by the original document and
+    // the result is shared with all the clones
+    if (d.clone) {
+        if (d.source)
+            d.source->receiveMessage(message);
+        return;
+    }
+
     if (message->type() == IrcMessage::Batch) {
         IrcBatchMessage* batch = static_cast<IrcBatchMessage*>(message);
-        d.batch = true;
+        foreach (TextDocument* doc, family())
+            doc->d.batch = true;
         foreach (IrcMessage* msg, batch->messages())
             receiveMessage(msg);
-        d.batch = false;
-        if (!d.queue.isEmpty()) {
-            if (d.visible) {
-                flush();
-            } else if (d.dirty <= 0) {
-                d.dirty = startTimer(delay);
-                delay += 1000;
-            }
-        }
+        // the batch ends once its last line has come back from the workers
+        d.batched = true;
+        if (d.pipeline->isIdle())
+            endBatches();
     } else {
-        MessageData data = d.formatter->formatMessage(message);
+        d.pipeline->submit(message);
+    }
+}
+
+void TextDocument::deliver(IrcMessage* message, const MessageData& data)
+{
+    foreach (TextDocument* doc, family())
+        doc->receive(message, data);
+}
+
+void TextDocument::announce(int ticket, IrcMessage* message)
+{
+    foreach (TextDocument* doc, family()) {
+        const int pending = doc->notify(message, false);
+        if (pending)
+            doc->d.pending.insert(ticket, pending);
+    }
+}
+
+void TextDocument::complete(int ticket, const MessageData& data)
+{
+    foreach (TextDocument* doc, family()) {
+        const int pending = doc->d.pending.take(ticket);
+        if (pending & PendingUnread)
+            --doc->d.ahead;
         if (!data.isEmpty()) {
-            bool unseen = message->timeStamp() > latestMessageSeen();
+            doc->append(data);
+            if (pending & PendingHighlight)
+                doc->addHighlight(doc->totalCount() - 1);
+        }
+    }
+}
 
-            append(data);
+void TextDocument::endBatches()
+{
+    if (d.batched) {
+        d.batched = false;
+        foreach (TextDocument* doc, family())
+            doc->endBatch();
+    }
+}
 
-            if (unseen && isVisible() && !(message->isOwn() && data.type() == IrcMessage::Join))
-                setLatestMessageSeen(message->timeStamp());
+void TextDocument::receive(IrcMessage* message, const MessageData& data)
+{
+    append(data);
+    notify(message, true);
+}
 
-            if (data.type() == IrcMessage::Private || data.type() == IrcMessage::Notice) {
-                if (unseen)
-                    emit messageReceived(message);
-
-                if (!message->isOwn()) {
-                    QString content;
-                    bool priv = false;
-                    if (data.type() == IrcMessage::Private) {
-                        IrcPrivateMessage* pm = static_cast<IrcPrivateMessage*>(message);
-                        content = pm->content();
-                        priv = pm->isPrivate();
-                    } else {
-                        IrcNoticeMessage* nm = static_cast<IrcNoticeMessage*>(message);
-                        content = nm->content();
-                        priv = nm->isPrivate();
-                    }
-                    IrcConnection* connection = message->connection();
-                    const bool contains = content.contains(connection->nickName(), Qt::CaseInsensitive);
-                    if (contains) {
-                        if (connection->isConnected())
-                            addHighlight(totalCount() - 1);
-                        if (unseen)
-                            emit messageHighlighted(message);
-                    } else if (unseen && priv && connection->isConnected()) {
-                        emit privateMessageReceived(message);
-                    }
+// marks the message seen or announces it, and returns what is left for
+// when its line comes in, unless the line is in already
+int TextDocument::notify(IrcMessage* message, bool appended)
+{
+    int pending = 0;
+    const IrcMessage::Type type = MessageData::effectiveType(message);
+    const bool unseen = message->timeStamp() > latestMessageSeen();
+
+    if (unseen && isVisible() && !(message->isOwn() && type == IrcMessage::Join)) {
+        setLatestMessageSeen(message->timeStamp());
+    } else if (unseen && !appended && (type == IrcMessage::Private || type == IrcMessage::Notice)) {
+        // counted ahead, so that the count is right by the time it is announced
+        pending |= PendingUnread;
+        ++d.ahead;
+    }
+
+    if (type == IrcMessage::Private || type == IrcMessage::Notice) {
+        if (unseen)
+            emit messageReceived(message);
+
+        if (!message->isOwn()) {
+            QString content;
+            bool priv = false;
+            if (type == IrcMessage::Private) {
+                IrcPrivateMessage* pm = static_cast<IrcPrivateMessage*>(message);
+                content = pm->content();
+                priv = pm->isPrivate();
+            } else {
+                IrcNoticeMessage* nm = static_cast<IrcNoticeMessage*>(message);
+                content = nm->content();
+                priv = nm->isPrivate();
+            }
+            IrcConnection* connection = message->connection();
+            const bool contains = content.contains(connection->nickName(), Qt::CaseInsensitive);
+            if (contains) {
+                if (connection->isConnected()) {
+                    if (appended)
+                        addHighlight(totalCount() - 1);
+                    else
+                        pending |= PendingHighlight;
                 }
+                if (unseen)
+                    emit messageHighlighted(message);
+            } else if (unseen && priv && connection->isConnected()) {
+                emit privateMessageReceived(message);
             }
         }
     }
+    return pending;
+}
+
+void TextDocument::endBatch()
+{
+    d.batch = false;
+    if (!d.queue.isEmpty() && d.loaded && !d.rebuilding)
+        FlushScheduler::instance()->schedule(this);
+}
+
+int TextDocument::flushPriority() const
+{
+    // visible first, then highlighted, then the most recently viewed
+    if (d.visible)
+        return 0;
+    if (d.unreadHighlights > 0)
+        return 1;
+    const int index = recent.indexOf(const_cast<TextDocument*>(this));
+    return 2 + (index != -1 ? index : maximumRecent);
+}
+
+QList<TextDocument*> TextDocument::family()
+{
+    return QList<TextDocument*>() << this << d.clones;
 }
 
 void TextDocument::rebuild()
 {
-    QList<MessageData> lines;
-    QTextBlock block = firstBlock();
-    while (block.isValid()) {
-        TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
-        if (blockData)
-            lines += blockData->data;
-        block = block.next();
+    if (!d.visible) {
+        // picked up again when shown
+        if (d.rebuild > 0)
+            killTimer(d.rebuild);
+        d.rebuild = -1;
+        d.rebuilding = false;
+        recent.removeOne(this);
+        unload();
+        return;
     }
-    clear();
-    d.queue = lines;
-    flush();
-    if (d.rebuild > 0) {
+
+    if (!d.rebuilding) {
+        requeue();
+        d.expanded = 0;
+        setMaximumBlockCount(capacity());
+
+        // only the lines that fit the window are laid out again
+        const int excess = d.queue.count() - capacity();
+        if (excess > 0) {
+            evict(excess);
+            d.queue.erase(d.queue.begin(), d.queue.begin() + excess);
+        }
+        d.rebuilding = true;
+        FlushScheduler::instance()->cancel(this);
+    }
+
+    // lay out a slice at a time and yield back to the event loop
+    QElapsedTimer elapsed;
+    elapsed.start();
+    const int budget = FlushScheduler::instance()->budget();
+    while (!d.queue.isEmpty() && elapsed.elapsed() < budget) {
+        QTextCursor cursor(this);
+        cursor.beginEditBlock();
+        insertQueue(cursor, qMin(sliceCount, d.queue.count()));
+        cursor.endEditBlock();
+    }
+
+    const int total = totalCount();
+    emit rebuildProgress(total - d.queue.count(), total);
+
+    if (d.queue.isEmpty()) {
+        if (d.rebuild > 0)
+            killTimer(d.rebuild);
+        d.rebuild = -1;
+        d.rebuilding = false;
+    }
+}
+
+void TextDocument::unload()
+{
+    if (!d.loaded || d.visible)
+        return;
+
+    // keep the plain message data and drop the laid out blocks
+    requeue();
+    FlushScheduler::instance()->cancel(this);
+    if (d.rebuild > 0)
         killTimer(d.rebuild);
-        d.rebuild = 0;
+    d.rebuild = -1;
+    d.rebuilding = false;
+    d.stamped = true;
+    d.loaded = false;
+
+    // lines paged in from the scrollback file go back out
+    d.paged = 0;
+    d.expanded = 0;
+    setMaximumBlockCount(capacity());
+    trim();
+}
+
+void TextDocument::requeue()
+{
+    // every line in memory goes back to the queue, numbered from the oldest held one
+    d.queue = lines();
+    d.sequence -= d.held.count();
+    d.held.clear();
+    clear();
+}
+
+void TextDocument::trim()
+{
+    const int diff = d.queue.count() - (d.maximum + d.paged);
+    if (diff > 0) {
+        evict(diff);
+        d.queue.erase(d.queue.begin(), d.queue.begin() + diff);
+    }
+}
+
+void TextDocument::evict(int count)
+{
+    for (int i = 0; i < count; ++i)
+        d.held += line(i);
+    advance(count);
+}
+
+void TextDocument::overflow()
+{
+    // a windowed document holds the lines that no longer fit its window as
+    // long as they fit in memory, anything else is spilled right away
+    const int room = d.loaded && d.window > 0 ? qMax(0, d.maximum + d.paged - capacity()) : 0;
+    while (d.held.count() > room) {
+        const qint64 sequence = d.sequence - d.held.count();
+        const MessageData line = d.held.takeFirst();
+        discount(line, sequence);
+        spill(line, isHighlighted(sequence));
+    }
+    while (!d.highlights.isEmpty() && d.highlights.first() < d.sequence - d.held.count())
+        d.highlights.removeFirst();
+
+    // held lines stay in the index, so that they can be found without being laid out
+    d.index.removeBefore(d.sequence - d.held.count());
+}
+
+int TextDocument::capacity() const
+{
+    const int limit = d.maximum + d.paged;
+    if (d.window > 0)
+        return qMin(limit, d.window + d.expanded);
+    return limit;
+}
+
+void TextDocument::spill(const MessageData& line, bool highlighted)
+{
+    if (!d.scrollback)
+        return;
+
+    // the family evicts the same lines in the same order, so a line
+    // is written once and the others just step past its record
+    if (d.spilled < d.scrollback->size()) {
+        d.spilled = d.scrollback->skip(d.spilled);
+    } else {
+        d.scrollback->append(line, highlighted);
+        d.spilled = d.scrollback->size();
     }
 }
 
 void TextDocument::scheduleRebuild()
 {
-    if (d.rebuild < 0 && !isEmpty())
-        d.rebuild = startTimer(isVisible() ? 0 : 1000);
+    // documents without laid out blocks pick up the change when flushed
+    if (!d.loaded || isEmpty())
+        return;
+
+    if (!d.visible) {
+        recent.removeOne(this);
+        unload();
+    } else {
+        // an ongoing rebuild starts over with the latest settings
+        d.rebuilding = false;
+        if (d.rebuild <= 0)
+            d.rebuild = startTimer(0);
+    }
 }
 
-void TextDocument::shiftLights(int diff)
+void TextDocument::prepend(const QList<MessageData>& history)
 {
-    QList<int>::iterator it = d.highlights.begin();
-    while (it != d.highlights.end()) {
-        *it -= diff;
-        if (*it < 0)
-            it = d.highlights.erase(it);
-        else
-            ++it;
+    // history only fills a document that has not scrolled anything out yet
+    if (history.isEmpty() || d.spilled > 0 || d.paged > 0)
+        return;
+
+    requeue();
+    const QList<MessageData> current = d.queue;
+    QDateTime first;
+    foreach (const MessageData& data, current) {
+        if (data.timestamp().isValid()) {
+            first = data.timestamp();
+            break;
+        }
+    }
+
+    QList<MessageData> older;
+    foreach (const MessageData& data, history) {
+        if (!first.isValid() || data.timestamp() < first)
+            older += data;
+    }
+    older = older.mid(qMax(0, older.count() - (d.maximum - current.count())));
+    if (older.isEmpty()) {
+        if (d.loaded)
+            flush();
+        return;
     }
-    d.lowlight -= diff;
+
+    QList<MessageData> restored;
+    foreach (const MessageData& data, older + current.mid(0, 1)) {
+        if (!restored.isEmpty() && data.timestamp().isValid() && data.timestamp().date() != restored.last().timestamp().date())
+            restored += dateChange(data.timestamp().date());
+        restored += data;
+    }
+    if (!current.isEmpty())
+        restored.removeLast();
+
+    // numbered ahead of the current lines, which keep their numbers and
+    // highlights, and laid out again in one go
+    d.sequence -= restored.count();
+    d.queue = restored + current;
+    trim();
+    if (d.loaded)
+        flush();
+
+    // the log was written in an earlier session, so what it restores was seen
+    const QDateTime newest = older.last().timestamp();
+    if (newest.isValid() && (!d.latestMessageSeen.isValid() || newest > d.latestMessageSeen))
+        setLatestMessageSeen(newest);
+    else
+        recount();
+}
+
+void TextDocument::advance(int count)
+{
+    // lines are keyed by sequence number, so evicting only moves the
+    // first number forward, and the highlights go with the spilled lines
+    d.sequence += count;
+    overflow();
 }
 
 void TextDocument::insert(QTextCursor& cursor, const MessageData& data)
@@ -594,21 +1475,284 @@ void TextDocument::insert(QTextCursor& cursor, const MessageData& data)
         cursor.insertBlock();
 
         if (count >= max) {
+            // within an edit block, the excess blocks are removed when
+            // the block ends, so the line to go is not necessarily first
+            d.held += line(count - max);
             emit lineRemoved(qRound(br.bottom()));
-            shiftLights(max - count + 1);
+            advance(1);
+        }
+    }
+
+    insertLine(cursor, data);
+    setupBlock(cursor, data);
+}
+
+void TextDocument::insertQueue(QTextCursor& cursor, int count)
+{
+    // evict once for the whole batch instead of once per line
+    const int blocks = isEmpty() ? 0 : blockCount();
+    const int excess = blocks + count - maximumBlockCount();
+    if (excess > 0) {
+        const int removed = qMin(excess, blocks);
+        const MessageData first = line(removed);
+        evict(excess);
+
+        if (removed > 0) {
+            const QRectF br = documentLayout()->blockBoundingRect(findBlockByNumber(removed - 1));
+            cursor.setPosition(0);
+            if (removed < blocks) {
+                // the surviving first block may have kept the data of a removed one
+                cursor.setPosition(findBlockByNumber(removed).position(), QTextCursor::KeepAnchor);
+                cursor.removeSelectedText();
+                setupBlock(cursor, first);
+            } else {
+                cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+                cursor.removeSelectedText();
+            }
+            emit lineRemoved(qRound(br.bottom()));
+        }
+        d.queue.erase(d.queue.begin(), d.queue.begin() + excess - removed);
+        count -= excess - removed;
+    }
+
+    const QList<MessageData> batch = d.queue.mid(0, count);
+    d.queue.erase(d.queue.begin(), d.queue.begin() + count);
+    if (batch.isEmpty())
+        return;
+
+    // lay out the batch as a single fragment, one block per line
+    QTextDocument scratch;
+    scratch.setDefaultStyleSheet(defaultStyleSheet());
+    QTextCursor builder(&scratch);
+    for (int i = 0; i < batch.count(); ++i) {
+        if (i > 0)
+            builder.insertBlock();
+        insertLine(builder, batch.at(i));
+    }
+
+    cursor.movePosition(QTextCursor::End);
+    if (!isEmpty())
+        cursor.insertBlock();
+    const int number = cursor.blockNumber();
+    cursor.insertFragment(QTextDocumentFragment(&scratch));
+
+    // user data and block formats in one pass over the new blocks
+    QTextBlock block = findBlockByNumber(number);
+    foreach (const MessageData& data, batch) {
+        QTextCursor blockCursor(block);
+        setupBlock(blockCursor, data);
+        block = block.next();
+    }
+}
+
+void TextDocument::layoutOlder(QList<MessageData> older)
+{
+    const int count = older.count();
+    if (d.window > 0)
+        d.expanded += count;
+    setMaximumBlockCount(maximumBlockCount() + count);
+
+    QTextCursor cursor(this);
+    cursor.beginEditBlock();
+    if (isEmpty()) {
+        foreach (const MessageData& data, older)
+            insert(cursor, data);
+    } else {
+        // splitting the first block leaves its user data and format on
+        // either side, so both are reassigned for every touched block
+        older += line(0);
+        for (int i = 0; i < count; ++i) {
+            insertLine(cursor, older.at(i));
+            cursor.insertBlock();
+        }
+        QTextBlock block = firstBlock();
+        foreach (const MessageData& data, older) {
+            QTextCursor blockCursor(block);
+            setupBlock(blockCursor, data);
+            block = block.next();
         }
     }
+    cursor.endEditBlock();
+    emit linesFetched(count);
+}
 
-    cursor.insertHtml(formatBlock(data.timestamp(), data.format()));
-    cursor.block().setUserData(new TextBlockMessageData(data));
+void TextDocument::insertLine(QTextCursor& cursor, const MessageData& data)
+{
+    // lines formatted on a worker come split into runs already
+    QList<StyledText::Run> runs = data.runs();
+    if (runs.isEmpty()) {
+        d.styled.insert(cursor, formatBlock(data.timestamp(), data.format()));
+        return;
+    }
 
-    QTextBlockFormat format = cursor.blockFormat();
+    StyledText::Run time;
+    time.text = timeText(data.timestamp());
+    time.style = QStringLiteral("<span class='timestamp'>");
+    StyledText::Run space;
+    space.text = QStringLiteral(" ");
+    runs.prepend(space);
+    runs.prepend(time);
+    d.styled.insert(cursor, runs);
+}
+
+void TextDocument::setupBlock(QTextCursor& cursor, const MessageData& data)
+{
+    // the runs are of no use once the line is laid out
+    MessageData stored = data;
+    stored.setRuns(QList<StyledText::Run>());
+
+    QTextBlock block = cursor.block();
+    block.setUserData(new TextBlockMessageData(stored));
+
+    // replaces the format entirely, including any paragraph margins from html
+    QTextBlockFormat format;
     format.setLineHeight(125, QTextBlockFormat::ProportionalHeight);
     if (data.type() == IrcMessage::Unknown)
         format.setAlignment(Qt::AlignRight);
     else
         format.setAlignment(Qt::AlignLeft);
     cursor.setBlockFormat(format);
+
+    // lines that arrive while a filter is applied are filtered too
+    block.setVisible(d.filter.isEmpty() || passesFilter(block));
+
+    // mark the time stamp run so that it can be rewritten in place
+    const int length = timeText(data.timestamp()).length();
+    if (length > 0) {
+        QTextCursor run(block);
+        run.setPosition(block.position() + length, QTextCursor::KeepAnchor);
+        QTextCharFormat marker;
+        marker.setProperty(TimeStampProperty, true);
+        run.mergeCharFormat(marker);
+    }
+}
+
+void TextDocument::updateTimeStamps()
+{
+    QTextCursor cursor(this);
+    cursor.beginEditBlock();
+    for (QTextBlock block = begin(); block.isValid(); block = block.next()) {
+        TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
+        if (!blockData)
+            continue;
+
+        int length = 0;
+        QTextCharFormat format;
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            if (!fragment.charFormat().hasProperty(TimeStampProperty))
+                break;
+            if (!length)
+                format = fragment.charFormat();
+            length += fragment.length();
+        }
+
+        if (length > 0) {
+            cursor.setPosition(block.position());
+            cursor.setPosition(block.position() + length, QTextCursor::KeepAnchor);
+            cursor.insertText(timeText(blockData->data.timestamp()), format);
+        }
+    }
+    cursor.endEditBlock();
+    d.stamped = true;
+}
+
+void TextDocument::updateIndex()
+{
+    // indexed on demand, except for the last line while events may still merge into it
+    const int count = isEmpty() ? 0 : blockCount() - 1;
+    if (count <= 0)
+        return;
+
+    // held lines and lines paged in from the scrollback file
+    const qint64 oldest = d.sequence - d.held.count();
+    const qint64 before = d.index.isEmpty() ? d.sequence : qMin(d.index.first(), d.sequence + count);
+    for (qint64 sequence = before - 1; sequence >= oldest; --sequence) {
+        if (sequence >= d.sequence)
+            d.index.add(sequence, searchText(findBlockByNumber(sequence - d.sequence)));
+        else
+            d.index.add(sequence, lineText(d.held.at(sequence - oldest), d.timeStampFormat));
+    }
+
+    const qint64 from = d.index.isEmpty() ? d.sequence : qMax(d.index.last() + 1, d.sequence);
+    for (QTextBlock block = findBlockByNumber(from - d.sequence); block.isValid() && block.blockNumber() < count; block = block.next())
+        d.index.add(d.sequence + block.blockNumber(), searchText(block));
+}
+
+bool TextDocument::passesFilter(const QTextBlock& block) const
+{
+    TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
+    if (!blockData)
+        return false;
+
+    if (!d.filter.text().isEmpty() && !searchText(block).contains(d.filter.text(), Qt::CaseInsensitive))
+        return false;
+    return d.filter.matches(blockData->data, isHighlighted(d.sequence + block.blockNumber()));
+}
+
+void TextDocument::discount(const MessageData& line, qint64 sequence)
+{
+    if (isUnread(line)) {
+        --d.unread;
+        if (isHighlighted(sequence))
+            --d.unreadHighlights;
+    }
+}
+
+void TextDocument::recount()
+{
+    d.unread = 0;
+    d.unreadHighlights = 0;
+
+    // Note: The following logic assumes the queue and blocks are ordered by time
+
+    // held lines are numbered below the first laid out one
+    for (int i = totalCount() - 1; i >= -d.held.count(); --i) {
+        const MessageData message = i >= 0 ? line(i) : d.held.at(d.held.count() + i);
+        if (message.hasTimestamp() && message.timestampMSecs() <= d.seen)
+            break;
+
+        if (isUnread(message)) {
+            ++d.unread;
+            if (isHighlighted(d.sequence + i))
+                ++d.unreadHighlights;
+        }
+    }
+}
+
+bool TextDocument::isHighlighted(qint64 sequence) const
+{
+    return qBinaryFind(d.highlights, sequence) != d.highlights.constEnd();
+}
+
+bool TextDocument::isUnread(const MessageData& line) const
+{
+    // compared as milliseconds, since this runs for every line that is counted
+    return (line.type() == IrcMessage::Private || line.type() == IrcMessage::Notice)
+           && line.hasTimestamp() && line.timestampMSecs() > d.seen;
+}
+
+MessageData TextDocument::line(int number) const
+{
+    const int blocks = isEmpty() ? 0 : blockCount();
+    if (number >= blocks)
+        return d.queue.value(number - blocks);
+
+    TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(findBlockByNumber(number).userData());
+    if (blockData)
+        return blockData->data;
+    return MessageData();
+}
+
+QList<MessageData> TextDocument::lines() const
+{
+    QList<MessageData> lines = d.held;
+    for (QTextBlock block = firstBlock(); block.isValid(); block = block.next()) {
+        TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
+        if (blockData)
+            lines += blockData->data;
+    }
+    return lines + d.queue;
 }
 
 QString TextDocument::formatEvents(const QList<MessageData>& events) const
@@ -618,7 +1762,10 @@ QString TextDocument::formatEvents(const QList<MessageData>& events) const
 
     QStringList lines;
     foreach (const MessageData& event, events) {
-        if (!event.isEmpty()) {
+        if (event.isCollapsed()) {
+            foreach (const QString& line, d.formatter->formatReply(event))
+                lines += formatBlock(event.timestamp(), line);
+        } else if (!event.isEmpty() && !event.data().isEmpty()) {
             IrcMessage* msg = IrcMessage::fromData(event.data(), d.buffer->connection());
             lines += formatBlock(event.timestamp(), formatter.formatMessage(msg).format());
             delete msg;
@@ -701,8 +1848,16 @@ QString TextDocument::formatBlock(const QDateTime& timestamp, const QString& mes
     if (message.isEmpty())
         return QString();
 
-    const QString time = timestamp.time().toString(d.timeStampFormat);
+    const QString time = timeText(timestamp).toHtmlEscaped();
     return tr("<span class='timestamp'>%1</span> %2").arg(time, message);
 }
 
+QString TextDocument::timeText(const QDateTime& timestamp) const
+{
+    // non-breaking spaces survive the html import, so the
+    // length of the laid out time stamp run is known up front
+    QString time = timestamp.time().toString(d.timeStampFormat);
+    return time.replace(QLatin1Char(' '), QChar(QChar::Nbsp));
+}
+
 #include "textdocument.moc"
@@ -31,14 +31,23 @@
 
 #include <QTextDocument>
 #include <QMetaType>
+#include <QHash>
 #include <QDateTime>
+#include <QPointer>
+#include <QSharedPointer>
 #include "baseglobal.h"
+#include "linefilter.h"
 #include "messagedata.h"
+#include "searchindex.h"
+#include "styledtext.h"
 
 class IrcBuffer;
 class IrcMessage;
 class MessageData;
+class FormatPipeline;
 class MessageFormatter;
+class ScrollbackFile;
+class QTextBlock;
 
 class BASE_EXPORT TextDocument : public QTextDocument
 {
@@ -46,6 +55,7 @@ class BASE_EXPORT TextDocument : public QTextDocument
 
 public:
     explicit TextDocument(IrcBuffer* buffer);
+    ~TextDocument();
 
     QString timeStampFormat() const;
     void setTimeStampFormat(const QString& format);
@@ -61,6 +71,24 @@ public:
 
     int totalCount() const;
 
+    int maximumLineCount() const;
+    void setMaximumLineCount(int count);
+
+    int visibleLines() const;
+    void setVisibleLines(int count);
+
+    bool canFetchMore() const;
+    void fetchMore();
+
+    void restore(const QList<MessageData>& history);
+
+    QList<MessageData> lines() const;
+    QList<int> search(const QString& text);
+    bool findOlder(const QString& text);
+
+    LineFilter filter() const;
+    int applyFilter(const QString& query);
+
     bool isVisible() const;
     void setVisible(bool visible);
 
@@ -69,11 +97,13 @@ public:
     QDateTime latestMessageReceived() const;
 
     int unreadMessages() const;
+    int unreadHighlights() const;
 
     void drawBackground(QPainter* painter, const QRect& bounds);
     void drawForeground(QPainter* painter, const QRect& bounds);
 
     QString tooltip(const QPoint& pos) const;
+    bool expand(int block);
 
 public slots:
     void reset();
@@ -86,6 +116,8 @@ public slots:
 
 signals:
     void lineRemoved(int height);
+    void linesFetched(int count);
+    void rebuildProgress(int value, int maximum);
     void messageReceived(IrcMessage* message);
     void messageHighlighted(IrcMessage* message);
     void privateMessageReceived(IrcMessage* message);
@@ -98,32 +130,91 @@ protected:
 private slots:
     void flush();
     void rebuild();
+    void fetched(qint64 from, qint64 to, const QList<MessageData>& older, const QList<int>& lights);
+    void missed();
+    void deliver(IrcMessage* message, const MessageData& data);
+    void announce(int ticket, IrcMessage* message);
+    void complete(int ticket, const MessageData& data);
+    void endBatches();
 
 private:
+    explicit TextDocument(TextDocument* source);
+    void init(IrcBuffer* buffer);
+    void receive(IrcMessage* message, const MessageData& data);
+    int notify(IrcMessage* message, bool appended);
+    void endBatch();
+    QList<TextDocument*> family();
+    int flushPriority() const;
+
+    void unload();
+    void requeue();
+    void trim();
+    void evict(int count);
+    void overflow();
+    int capacity() const;
+    void insertQueue(QTextCursor& cursor, int count);
+    void layoutOlder(QList<MessageData> older);
+    void insertLine(QTextCursor& cursor, const MessageData& data);
+    void setupBlock(QTextCursor& cursor, const MessageData& data);
+    void updateTimeStamps();
+    void updateIndex();
+    bool passesFilter(const QTextBlock& block) const;
+    void spill(const MessageData& line, bool highlighted);
     void scheduleRebuild();
-    void shiftLights(int diff);
+    void prepend(const QList<MessageData>& history);
+    void advance(int count);
+    void discount(const MessageData& line, qint64 sequence);
+    void recount();
+    bool isHighlighted(qint64 sequence) const;
+    bool isUnread(const MessageData& line) const;
+    MessageData line(int number) const;
 
     QString formatEvents(const QList<MessageData>& events) const;
     QString formatSummary(const QList<MessageData>& events) const;
     QString formatBlock(const QDateTime& timestamp, const QString& message) const;
+    QString timeText(const QDateTime& timestamp) const;
 
     friend class TextBrowser;
+    friend class FlushScheduler;
 
     struct Private {
-        int scrollbackMarkerPosition;
-        int dirty;
+        qint64 scrollbackMarkerPosition;
         bool clone;
         bool batch;
+        bool batched;
+        bool loaded;
         int rebuild;
+        bool rebuilding;
+        bool stamped;
+        int maximum;
+        int window;
+        int expanded;
+        int paged;
+        qint64 spilled;
+        bool fetching;
         QString css;
-        int lowlight;
+        StyledText styled;
+        SearchIndex index;
+        LineFilter filter;
+        qint64 lowlight;
+        qint64 sequence;
         bool visible;
+        int unread;
+        int unreadHighlights;
+        int ahead;
+        QHash<int, int> pending;
         IrcBuffer* buffer;
         QDateTime latestMessageSeen;
-        QList<int> highlights;
+        qint64 seen;
+        QList<qint64> highlights;
         QString timeStampFormat;
         QList<MessageData> queue;
+        QList<MessageData> held;
         MessageFormatter* formatter;
+        FormatPipeline* pipeline;
+        QPointer<TextDocument> source;
+        QList<TextDocument*> clones;
+        QSharedPointer<ScrollbackFile> scrollback;
     } d;
 };
 
@@ -28,11 +28,11 @@
 
 #include "titlebar.h"
 #include "messageformatter.h"
+#include "nickindex.h"
 #include <QStyleOptionHeader>
 #include <QPropertyAnimation>
 #include <QStylePainter>
 #include <IrcTextFormat>
-#include <IrcUserModel>
 #include <QApplication>
 #include <QMouseEvent>
 #include <QHeaderView>
@@ -65,7 +65,6 @@ protected:
 TitleBar::TitleBar(QWidget* parent) : QLabel(parent)
 {
     d.buffer = 0;
-    d.model = 0;
     d.baseOffset = -1;
     d.editor = 0;
     d.formatter = new MessageFormatter(this);
@@ -92,6 +91,12 @@ TitleBar::TitleBar(QWidget* parent) : QLabel(parent)
     relayout();
 }
 
+TitleBar::~TitleBar()
+{
+    if (d.nicks)
+        d.nicks->release();
+}
+
 QMenu* TitleBar::menu() const
 {
     return d.menuButton->menu();
@@ -168,8 +173,11 @@ void TitleBar::setBuffer(IrcBuffer* buffer)
                 disconnect(channel, SIGNAL(destroyed(IrcChannel*)), this, SLOT(cleanup()));
                 disconnect(channel, SIGNAL(topicChanged(QString)), this, SLOT(refresh()));
                 disconnect(channel, SIGNAL(modeChanged(QString)), this, SLOT(refresh()));
-                if (d.model)
-                    d.model->setChannel(0);
+                if (d.nicks) {
+                    disconnect(d.nicks, SIGNAL(countChanged(int)), this, SLOT(refresh()));
+                    d.nicks->release();
+                    d.nicks = 0;
+                }
             } else {
                 disconnect(d.buffer, SIGNAL(destroyed(IrcBuffer*)), this, SLOT(cleanup()));
             }
@@ -182,11 +190,8 @@ void TitleBar::setBuffer(IrcBuffer* buffer)
                 connect(channel, SIGNAL(destroyed(IrcChannel*)), this, SLOT(cleanup()));
                 connect(channel, SIGNAL(topicChanged(QString)), this, SLOT(refresh()));
                 connect(channel, SIGNAL(modeChanged(QString)), this, SLOT(refresh()));
-                if (!d.model) {
-                    d.model = new IrcUserModel(this);
-                    connect(d.model, SIGNAL(countChanged(int)), this, SLOT(refresh()));
-                }
-                d.model->setChannel(channel);
+                d.nicks = NickIndex::acquire(channel);
+                connect(d.nicks, SIGNAL(countChanged(int)), this, SLOT(refresh()));
             } else {
                 connect(d.buffer, SIGNAL(destroyed(IrcBuffer*)), this, SLOT(cleanup()));
             }
@@ -319,8 +324,8 @@ void TitleBar::refresh()
     QStringList info;
 //    if (channel && !channel->mode().isEmpty())
 //        info += channel->mode();
-    if (d.model && d.model->count() > 0)
-        info += QString::number(d.model->count());
+    if (d.nicks && d.nicks->count() > 0)
+        info += QString::number(d.nicks->count());
 
     if (info.isEmpty() && topic.isEmpty())
         setText(title);
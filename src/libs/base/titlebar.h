@@ -30,12 +30,13 @@
 #define TITLEBAR_H
 
 #include <QLabel>
+#include <QPointer>
 #include <QTextEdit>
 #include <QToolButton>
 #include "baseglobal.h"
 
 class IrcBuffer;
-class IrcUserModel;
+class NickIndex;
 class MessageFormatter;
 
 class BASE_EXPORT TitleBar : public QLabel
@@ -45,6 +46,7 @@ class BASE_EXPORT TitleBar : public QLabel
 
 public:
     explicit TitleBar(QWidget* parent = 0);
+    ~TitleBar();
 
     IrcBuffer* buffer() const;
     QString topic() const;
@@ -95,7 +97,7 @@ private:
         QTextEdit* editor;
         QToolButton* menuButton;
         MessageFormatter* formatter;
-        IrcUserModel* model;
+        QPointer<NickIndex> nicks;
     } d;
 };
 
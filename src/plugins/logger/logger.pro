@@ -7,4 +7,6 @@ COMMUNI += core model
 CONFIG += communi_plugin
 
 HEADERS += $$PWD/loggerplugin.h
+HEADERS += $$PWD/logwriter.h
 SOURCES += $$PWD/loggerplugin.cpp
+SOURCES += $$PWD/logwriter.cpp
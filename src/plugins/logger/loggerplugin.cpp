@@ -27,6 +27,8 @@
 */
 
 #include "loggerplugin.h"
+#include "logwriter.h"
+#include "logarchive.h"
 #include <IrcConnection>
 #include <IrcNetwork>
 #include <IrcMessage>
@@ -36,13 +38,18 @@
 #include <IrcBufferModel>
 #include <Irc>
 #include <QDir>
-#include <QTextStream>
+#include <QFileInfo>
 #include <QSettings>
 #include <QDebug>
 
 LoggerPlugin::LoggerPlugin(QObject* parent) : QObject(parent)
+    , m_structured(false)
     , m_connections(0)
 {
+    // file io happens on the writer's own thread, away from the gui
+    m_writer = new LogWriter(this);
+    m_writer->start(QThread::LowPriority);
+
     this->settingsChanged();
 }
 
@@ -52,6 +59,9 @@ LoggerPlugin::~LoggerPlugin()
     foreach (IrcBuffer *buf, this->m_logitems.keys()) {
         this->removeLogitemForBuffer(buf);
     }
+
+    // drains the queue and syncs before the thread exits
+    delete m_writer;
 }
 
 void LoggerPlugin::setConnectionsList(const QList<IrcConnection*>* list)
@@ -95,14 +105,15 @@ void LoggerPlugin::bufferAdded(IrcBuffer* buffer)
 
     connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(logMessage(IrcMessage*)));
 
-    const QString filename = logfileName(buffer);
+    const QString filename = LogArchive::logFileName(buffer);
     Item item;
-    item.logfile = new QFile(m_logDirPath + "/" + filename, this);
-    item.logfile->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
-    item.textStream = new QTextStream(item.logfile);
+    item.logfile = m_logDirPath + "/" + filename;
+    // the structured log sits next to the text log, with every message kept whole
+    if (m_structured)
+        item.recordfile = MessageLog::recordPath(item.logfile);
 
     this->m_logitems.insert(buffer, item);
-    writeToFile(buffer, "=== Logfile started on " + timestamp() + " ===");
+    writeToFile(buffer, "=== Logfile started on " + timestamp() + " ===", false);
 }
 
 void LoggerPlugin::bufferRemoved(IrcBuffer* buffer)
@@ -115,12 +126,9 @@ void LoggerPlugin::bufferRemoved(IrcBuffer* buffer)
 void LoggerPlugin::removeLogitemForBuffer(IrcBuffer *buffer) {
     if (this->m_logitems.contains(buffer)) {
         Item item = this->m_logitems.take(buffer);
-
-        item.textStream->flush();
-        delete item.textStream;
-
-        item.logfile->close();
-        delete item.logfile;
+        m_writer->close(item.logfile);
+        if (!item.recordfile.isEmpty())
+            m_writer->close(item.recordfile);
     }
 }
 
@@ -128,41 +136,68 @@ void LoggerPlugin::settingsChanged()
 {
     QSettings settings;
     QString loggingLocation = settings.value("loggingLocation").toString();
+    bool structured = settings.value("loggingStructured", false).toBool();
 
-    if (m_logDirPath != loggingLocation) {
+    if (m_logDirPath != loggingLocation || m_structured != structured) {
         pluginDisabled();
 
         m_logDirPath = loggingLocation;
+        m_structured = structured;
         QDir logDir;
         if (!logDir.exists(m_logDirPath))
             logDir.mkpath(m_logDirPath);
 
         pluginEnabled();
     }
+
+    m_writer->setSyncInterval(settings.value("loggingSyncInterval", 2000).toInt());
+    m_writer->setMaximumOpenFiles(settings.value("loggingMaxOpenFiles", 64).toInt());
+    m_writer->setRotation(settings.value("loggingRotateDaily", false).toBool(),
+                          settings.value("loggingRotateSize", 0).toInt());
+}
+
+int LoggerPlugin::queueDepth() const
+{
+    return m_writer->queueDepth();
+}
+
+int LoggerPlugin::bytesPerSecond() const
+{
+    return m_writer->bytesPerSecond();
+}
+
+int LoggerPlugin::fileOpens() const
+{
+    return m_writer->openCount();
+}
+
+int LoggerPlugin::fileEvictions() const
+{
+    return m_writer->evictionCount();
 }
 
 void LoggerPlugin::logMessage(IrcMessage *message)
 {
+    IrcBuffer *buffer = qobject_cast<IrcBuffer*>(QObject::sender());
+
+    if (buffer && m_structured) {
+        const QString recordfile = this->m_logitems.value(buffer).recordfile;
+        m_writer->appendRecord(recordfile, message->timeStamp().toMSecsSinceEpoch(), message->type(), message->toData());
+    }
+
     if (message->type() != IrcMessage::Private)
         return;
 
-    IrcBuffer *buffer = qobject_cast<IrcBuffer*>(QObject::sender());
-
     if (buffer) {
         IrcPrivateMessage *m = static_cast<IrcPrivateMessage*>(message);
-        writeToFile(buffer, timestamp() + " " + m->nick() + ": " + m->content());
+        writeToFile(buffer, m->nick() + ": " + m->content());
     }
 }
 
-void LoggerPlugin::writeToFile(IrcBuffer* buffer, const QString &text)
-{
-    Item item = this->m_logitems[buffer];
-    *(item.textStream) << text << endl;
-}
-
-QString LoggerPlugin::logfileName(IrcBuffer *buffer) const
+void LoggerPlugin::writeToFile(IrcBuffer* buffer, const QString &text, bool stamped)
 {
-    return buffer->network()->name() + "_" + buffer->title() + ".log";
+    // the writer stamps the line with the time it was queued at
+    m_writer->append(this->m_logitems.value(buffer).logfile, text, stamped);
 }
 
 QString LoggerPlugin::timestamp() const
@@ -37,9 +37,7 @@
 #include "connectionplugin.h"
 #include "genericplugin.h"
 
-class QFile;
-class QTextStream;
-
+class LogWriter;
 class IrcChannel;
 class IrcPrivateMessage;
 
@@ -51,11 +49,15 @@ class LoggerPlugin : public QObject, public BufferPlugin, public SettingsPlugin,
     Q_PLUGIN_METADATA(IID "Communi.SettingsPlugin")
     Q_PLUGIN_METADATA(IID "Communi.ConnectionPlugin")
     Q_PLUGIN_METADATA(IID "Communi.GenericPlugin")
+    Q_PROPERTY(int queueDepth READ queueDepth)
+    Q_PROPERTY(int bytesPerSecond READ bytesPerSecond)
+    Q_PROPERTY(int fileOpens READ fileOpens)
+    Q_PROPERTY(int fileEvictions READ fileEvictions)
 
     struct Item
     {
-        QFile* logfile;
-        QTextStream* textStream;
+        QString logfile;
+        QString recordfile;
     };
 
 public:
@@ -68,17 +70,23 @@ public:
     void pluginEnabled();
     void pluginDisabled();
 
+    int queueDepth() const;
+    int bytesPerSecond() const;
+    int fileOpens() const;
+    int fileEvictions() const;
+
 private slots:
     void logMessage(IrcMessage *message);
     void removeLogitemForBuffer(IrcBuffer *buffer);
 
 private:
-    void writeToFile(IrcBuffer* buffer, const QString &text);
-    QString logfileName(IrcBuffer *buffer) const;
+    void writeToFile(IrcBuffer* buffer, const QString &text, bool stamped = true);
     QString timestamp() const;
 
     QString m_logDirPath;
+    bool m_structured;
     QMap<IrcBuffer*, Item> m_logitems;
+    LogWriter* m_writer;
     const QList<IrcConnection*>* m_connections;
 };
 
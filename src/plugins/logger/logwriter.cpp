@@ -0,0 +1,486 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "logwriter.h"
+#include "logarchive.h"
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QStringList>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QFile>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// the longest the writer sleeps, so that the rate decays when idle
+static const int idleTimeout = 1000;
+
+static void syncFile(QFile* file)
+{
+#ifdef Q_OS_WIN
+    ::_commit(file->handle());
+#else
+    ::fsync(file->handle());
+#endif
+}
+
+class CompressTask : public QRunnable
+{
+public:
+    CompressTask(const QString& filePath, bool indexed) : filePath(filePath), indexed(indexed) { }
+
+    void run()
+    {
+        if (indexed)
+            MessageLog::compress(filePath);
+        else
+            LogArchive::compress(filePath);
+    }
+
+private:
+    QString filePath;
+    bool indexed;
+};
+
+LogWriter::LogWriter(QObject* parent) : QThread(parent)
+    , m_tail(new Node)
+    , m_sleeping(0)
+    , m_depth(0)
+    , m_rate(0)
+    , m_syncInterval(2000)
+    , m_maxFiles(64)
+    , m_rotateDaily(0)
+    , m_rotateSize(0)
+    , m_opens(0)
+    , m_evictions(0)
+    , m_clock(0)
+    , m_written(0)
+    , m_stampSecond(-1)
+{
+    m_head.store(m_tail);
+}
+
+LogWriter::~LogWriter()
+{
+    stop();
+    wait();
+
+    // whatever was queued after the writer stopped, or if it never ran
+    Entry entry;
+    while (pop(&entry)) { }
+    delete m_tail;
+}
+
+int LogWriter::syncInterval() const
+{
+    return m_syncInterval.load();
+}
+
+void LogWriter::setSyncInterval(int msecs)
+{
+    m_syncInterval.store(msecs);
+}
+
+bool LogWriter::rotatesDaily() const
+{
+    return m_rotateDaily.load();
+}
+
+int LogWriter::rotationSize() const
+{
+    return m_rotateSize.load();
+}
+
+void LogWriter::setRotation(bool daily, int megabytes)
+{
+    m_rotateDaily.store(daily);
+    m_rotateSize.store(qMax(0, megabytes));
+}
+
+int LogWriter::maximumOpenFiles() const
+{
+    return m_maxFiles.load();
+}
+
+void LogWriter::setMaximumOpenFiles(int count)
+{
+    m_maxFiles.store(qMax(1, count));
+}
+
+int LogWriter::queueDepth() const
+{
+    return m_depth.load();
+}
+
+int LogWriter::bytesPerSecond() const
+{
+    return m_rate.load();
+}
+
+int LogWriter::openCount() const
+{
+    return m_opens.load();
+}
+
+int LogWriter::evictionCount() const
+{
+    return m_evictions.load();
+}
+
+void LogWriter::append(const QString& filePath, const QString& text, bool stamped)
+{
+    Entry entry;
+    entry.kind = stamped ? Line : Raw;
+    entry.timestamp = QDateTime::currentMSecsSinceEpoch();
+    entry.filePath = filePath;
+    entry.text = text;
+    push(entry);
+}
+
+void LogWriter::appendRecord(const QString& filePath, qint64 timestamp, int type, const QByteArray& data)
+{
+    Entry entry;
+    entry.kind = Record;
+    entry.timestamp = timestamp;
+    entry.type = type;
+    entry.filePath = filePath;
+    entry.data = data;
+    push(entry);
+}
+
+void LogWriter::close(const QString& filePath)
+{
+    Entry entry;
+    entry.kind = Close;
+    entry.filePath = filePath;
+    push(entry);
+}
+
+void LogWriter::stop()
+{
+    Entry entry;
+    entry.kind = Stop;
+    push(entry);
+}
+
+void LogWriter::push(const Entry& entry)
+{
+    Node* node = new Node;
+    node->entry = entry;
+
+    m_depth.ref();
+    Node* prev = m_head.fetchAndStoreOrdered(node);
+
+    // linking the node and checking for a parked writer are both sequentially
+    // consistent, as are the writer's raising of the flag and its re-check, so
+    // either the writer sees the node or this sees the flag
+    prev->next.fetchAndStoreOrdered(node);
+
+    // a busy writer picks the entry up anyway, only a parked one needs a wakeup
+    if (m_sleeping.testAndSetOrdered(1, 0))
+        m_wakeup.release();
+}
+
+bool LogWriter::pop(Entry* entry)
+{
+    Node* next = m_tail->next.loadAcquire();
+    if (!next)
+        return false;
+
+    // the popped node stays behind as the new tail, without its payload
+    *entry = next->entry;
+    next->entry = Entry();
+    delete m_tail;
+    m_tail = next;
+    m_depth.deref();
+    return true;
+}
+
+void LogWriter::run()
+{
+    QElapsedTimer syncTimer;
+    syncTimer.start();
+    QElapsedTimer rateTimer;
+    rateTimer.start();
+
+    bool stopping = false;
+    while (!stopping) {
+        Entry entry;
+        while (pop(&entry)) {
+            switch (entry.kind) {
+            case Line:
+                m_pending[entry.filePath] += stamp(entry.timestamp) + ' ' + entry.text.toLocal8Bit() + '\n';
+                break;
+            case Raw:
+                m_pending[entry.filePath] += entry.text.toLocal8Bit() + '\n';
+                break;
+            case Record: {
+                MessageLog::Record record;
+                record.timestamp = entry.timestamp;
+                record.type = entry.type;
+                record.data = entry.data;
+                m_records[entry.filePath] += record;
+                break;
+            }
+            case Close:
+                release(entry.filePath);
+                break;
+            case Stop:
+                stopping = true;
+                break;
+            }
+        }
+
+        foreach (const QString& filePath, m_pending.keys())
+            commit(filePath);
+        foreach (const QString& filePath, m_records.keys())
+            commitRecords(filePath);
+
+        const int interval = m_syncInterval.load();
+        if (stopping || (interval > 0 && syncTimer.elapsed() >= interval)) {
+            sync();
+            syncTimer.restart();
+        }
+
+        if (rateTimer.elapsed() >= 1000) {
+            m_rate.store(int(m_written * 1000 / rateTimer.restart()));
+            m_written = 0;
+        }
+
+        if (!stopping) {
+            int timeout = idleTimeout;
+            if (interval > 0 && !m_unsynced.isEmpty())
+                timeout = qBound(0, int(interval - syncTimer.elapsed()), idleTimeout);
+
+            // re-check after raising the flag, a push may have slipped in before it.
+            // a plain store and load could be reordered, see push()
+            m_sleeping.fetchAndStoreOrdered(1);
+            if (!m_tail->next.fetchAndAddOrdered(0))
+                m_wakeup.tryAcquire(1, timeout);
+            // a wakeup that arrives after this is consumed by a spare pass
+            m_sleeping.testAndSetOrdered(1, 0);
+        }
+    }
+
+    foreach (const QString& filePath, m_files.keys())
+        closeFile(filePath);
+}
+
+QByteArray LogWriter::stamp(qint64 msecs)
+{
+    // lines come in bursts, format each second only once
+    const qint64 second = msecs / 1000;
+    if (second != m_stampSecond) {
+        m_stampSecond = second;
+        m_stamp = QDateTime::fromMSecsSinceEpoch(second * 1000).toString("[yyyy-MM-dd] hh:mm:ss").toLocal8Bit();
+    }
+    return m_stamp;
+}
+
+QFile* LogWriter::file(const QString& filePath, bool text)
+{
+    QHash<QString, Handle>::iterator it = m_files.find(filePath);
+    if (it != m_files.end()) {
+        it->used = ++m_clock;
+        return it->file;
+    }
+
+    // files are opened on first write and evicted when the pool is full,
+    // appending again picks up where an evicted file left off
+    while (!m_files.isEmpty() && m_files.count() >= m_maxFiles.load())
+        evict();
+
+    Handle handle;
+    handle.file = new QFile(filePath);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly | QIODevice::Append;
+    if (text)
+        mode |= QIODevice::Text;
+    if (!handle.file->open(mode)) {
+        delete handle.file;
+        return 0;
+    }
+    m_opens.ref();
+    handle.used = ++m_clock;
+    m_files.insert(filePath, handle);
+    return handle.file;
+}
+
+void LogWriter::commit(const QString& filePath)
+{
+    const QByteArray data = m_pending.take(filePath);
+    if (data.isEmpty())
+        return;
+
+    // one write and one flush for everything that queued up for the file
+    QFile* file = this->file(filePath);
+    if (file && needsRotation(filePath, file, data.size())) {
+        rotate(filePath);
+        file = this->file(filePath);
+    }
+    if (file) {
+        const qint64 written = file->write(data);
+        file->flush();
+        if (written > 0) {
+            m_written += written;
+            m_unsynced.insert(filePath);
+        }
+    }
+}
+
+void LogWriter::commitRecords(const QString& filePath)
+{
+    const QList<MessageLog::Record> records = m_records.take(filePath);
+    if (records.isEmpty())
+        return;
+
+    // everything that queued up for the file becomes one checksummed segment
+    const QByteArray segment = MessageLog::encode(records);
+    QFile* file = this->file(filePath, false);
+    if (file && needsRotation(filePath, file, segment.size())) {
+        rotate(filePath);
+        file = this->file(filePath, false);
+    }
+    if (!file)
+        return;
+    const qint64 offset = file->size();
+    const qint64 written = file->write(segment);
+    file->flush();
+    if (written <= 0)
+        return;
+    m_written += written;
+    m_unsynced.insert(filePath);
+
+    // the time index stays sparse, with an entry per so many bytes of log
+    if (!m_indexed.contains(filePath) || offset - m_indexed.value(filePath) >= MessageLog::indexSpacing()) {
+        const QString indexPath = MessageLog::indexPath(filePath);
+        QFile* index = this->file(indexPath, false);
+        if (index) {
+            index->write(MessageLog::indexEntry(records.first().timestamp, offset));
+            index->flush();
+            m_unsynced.insert(indexPath);
+            m_indexed.insert(filePath, offset);
+        }
+    }
+}
+
+void LogWriter::release(const QString& filePath)
+{
+    commit(filePath);
+    commitRecords(filePath);
+
+    QStringList filePaths = QStringList() << filePath;
+    if (m_indexed.remove(filePath))
+        filePaths += MessageLog::indexPath(filePath);
+    foreach (const QString& path, filePaths)
+        closeFile(path);
+}
+
+void LogWriter::closeFile(const QString& filePath)
+{
+    const Handle handle = m_files.take(filePath);
+    if (handle.file) {
+        if (m_unsynced.remove(filePath))
+            syncFile(handle.file);
+        delete handle.file;
+    }
+}
+
+void LogWriter::evict()
+{
+    // the least recently written file goes
+    QHash<QString, Handle>::const_iterator oldest = m_files.constBegin();
+    for (QHash<QString, Handle>::const_iterator it = m_files.constBegin(); it != m_files.constEnd(); ++it) {
+        if (it->used < oldest->used)
+            oldest = it;
+    }
+    if (oldest != m_files.constEnd()) {
+        const QString filePath = oldest.key();
+        closeFile(filePath);
+        m_evictions.ref();
+    }
+}
+
+bool LogWriter::needsRotation(const QString& filePath, QFile* file, qint64 incoming)
+{
+    const qint64 size = file->size();
+    const QDate today = QDate::currentDate();
+
+    // the day of the last write, which is taken from the file the first time,
+    // and which is kept for rotate() to stamp the file with
+    QDate day = m_days.value(filePath);
+    if (!day.isValid()) {
+        day = size > 0 ? QFileInfo(filePath).lastModified().date() : today;
+        m_days.insert(filePath, day);
+    }
+
+    if (size > 0) {
+        const qint64 limit = qint64(m_rotateSize.load()) * 1024 * 1024;
+        if (limit > 0 && size + incoming > limit)
+            return true;
+        if (m_rotateDaily.load() && day != today)
+            return true;
+    }
+    m_days.insert(filePath, today);
+    return false;
+}
+
+void LogWriter::rotate(const QString& filePath)
+{
+    const QString indexPath = MessageLog::indexPath(filePath);
+    closeFile(filePath);
+    closeFile(indexPath);
+    m_indexed.remove(filePath);
+
+    // named after the day that was written to, at the time of the last write
+    const QDate today = QDate::currentDate();
+    const QDate day = m_days.value(filePath, today);
+    m_days.insert(filePath, today);
+    const QDateTime written(day, QFileInfo(filePath).lastModified().time());
+
+    const QString rotated = LogArchive::rotatedPath(filePath, written);
+    if (!QFile::rename(filePath, rotated))
+        return;
+    const bool indexed = QFile::exists(indexPath) && QFile::rename(indexPath, MessageLog::indexPath(rotated));
+
+    // the writer carries on with a fresh file while the pool compresses the old one
+    QThreadPool::globalInstance()->start(new CompressTask(rotated, indexed));
+}
+
+void LogWriter::sync()
+{
+    foreach (const QString& filePath, m_unsynced) {
+        QFile* file = m_files.value(filePath).file;
+        if (file)
+            syncFile(file);
+    }
+    m_unsynced.clear();
+}
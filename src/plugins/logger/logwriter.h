@@ -0,0 +1,144 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <QThread>
+#include <QAtomicPointer>
+#include <QSemaphore>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QString>
+#include <QDate>
+#include <QHash>
+#include <QSet>
+#include "messagelog.h"
+
+class QFile;
+
+class LogWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit LogWriter(QObject* parent = 0);
+    ~LogWriter();
+
+    int syncInterval() const;
+    void setSyncInterval(int msecs);
+
+    bool rotatesDaily() const;
+    int rotationSize() const;
+    void setRotation(bool daily, int megabytes);
+
+    int maximumOpenFiles() const;
+    void setMaximumOpenFiles(int count);
+
+    int queueDepth() const;
+    int bytesPerSecond() const;
+    int openCount() const;
+    int evictionCount() const;
+
+    void append(const QString& filePath, const QString& text, bool stamped = true);
+    void appendRecord(const QString& filePath, qint64 timestamp, int type, const QByteArray& data);
+    void close(const QString& filePath);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    enum Kind { Line, Raw, Record, Close, Stop };
+
+    struct Entry
+    {
+        Entry() : kind(Line), timestamp(0), type(0) { }
+        Kind kind;
+        qint64 timestamp;
+        int type;
+        QString filePath;
+        QString text;
+        QByteArray data;
+    };
+
+    struct Handle
+    {
+        Handle() : file(0), used(0) { }
+        QFile* file;
+        quint64 used;
+    };
+
+    struct Node
+    {
+        QAtomicPointer<Node> next;
+        Entry entry;
+    };
+
+    void push(const Entry& entry);
+    bool pop(Entry* entry);
+
+    QByteArray stamp(qint64 msecs);
+    QFile* file(const QString& filePath, bool text = true);
+    void commit(const QString& filePath);
+    void commitRecords(const QString& filePath);
+    void release(const QString& filePath);
+    void closeFile(const QString& filePath);
+    void evict();
+    bool needsRotation(const QString& filePath, QFile* file, qint64 incoming);
+    void rotate(const QString& filePath);
+    void sync();
+
+    // producers push at the head, the writer thread pops at the tail
+    QAtomicPointer<Node> m_head;
+    Node* m_tail;
+    QSemaphore m_wakeup;
+    QAtomicInt m_sleeping;
+    QAtomicInt m_depth;
+    QAtomicInt m_rate;
+    QAtomicInt m_syncInterval;
+    QAtomicInt m_maxFiles;
+    QAtomicInt m_rotateDaily;
+    QAtomicInt m_rotateSize;
+    QAtomicInt m_opens;
+    QAtomicInt m_evictions;
+
+    // only touched by the writer thread
+    QHash<QString, Handle> m_files;
+    quint64 m_clock;
+    QHash<QString, QByteArray> m_pending;
+    QHash<QString, QList<MessageLog::Record> > m_records;
+    QHash<QString, qint64> m_indexed;
+    QHash<QString, QDate> m_days;
+    QSet<QString> m_unsynced;
+    qint64 m_written;
+    qint64 m_stampSecond;
+    QByteArray m_stamp;
+};
+
+#endif // LOGWRITER_H
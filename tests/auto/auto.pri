@@ -0,0 +1,13 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = app
+TARGET = tst_$$basename(_PRO_FILE_PWD_)
+CONFIG += testcase communi communi_base
+CONFIG -= app_bundle
+COMMUNI += core model util
+QT += testlib widgets
+
+DEPENDPATH += $$PWD
+INCLUDEPATH += $$PWD
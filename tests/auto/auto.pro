@@ -0,0 +1,8 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = subdirs
+SUBDIRS += messagelog
+SUBDIRS += nickmatcher
+SUBDIRS += textdocument
@@ -0,0 +1,7 @@
+######################################################################
+# Communi
+######################################################################
+
+include(../auto.pri)
+
+SOURCES += $$PWD/tst_messagelog.cpp
@@ -0,0 +1,230 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include <IrcMessage>
+#include "messagelog.h"
+#include "logarchive.h"
+
+typedef QList<MessageLog::Record> Records;
+
+static const int perSegment = 3;
+
+class tst_MessageLog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void testRoundTrip();
+    void testCorruptPayload();
+    void testCorruptSize();
+    void testSeek();
+    void testLast();
+    void testCompressed();
+
+private:
+    void write(int segments, int padding = 0);
+    void patch(qint64 offset, const QByteArray& bytes);
+    Records records(int from, int to) const;
+    static void compare(const Records& actual, const Records& expected);
+
+    QTemporaryDir dir;
+    QString filePath;
+    QDateTime clock;
+    Records written;
+    QList<qint64> offsets;
+};
+
+void tst_MessageLog::init()
+{
+    QVERIFY(dir.isValid());
+    filePath = dir.path() + "/network_#communi.mlog";
+    QFile::remove(filePath);
+    QFile::remove(MessageLog::indexPath(filePath));
+    QFile::remove(filePath + LogArchive::suffix());
+    QFile::remove(MessageLog::indexPath(filePath + LogArchive::suffix()));
+
+    clock = QDateTime(QDate(2016, 1, 1), QTime(12, 0));
+    written.clear();
+    offsets.clear();
+}
+
+// segments written and indexed the way the logger writes them,
+// with every segment indexed so that seeks have somewhere to land
+void tst_MessageLog::write(int segments, int padding)
+{
+    QFile file(filePath);
+    QFile index(MessageLog::indexPath(filePath));
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    QVERIFY(index.open(QIODevice::WriteOnly | QIODevice::Append));
+
+    for (int i = 0; i < segments; ++i) {
+        Records segment;
+        for (int j = 0; j < perSegment; ++j) {
+            MessageLog::Record record;
+            record.timestamp = clock.addSecs(written.count()).toMSecsSinceEpoch();
+            record.type = IrcMessage::Private;
+            record.data = "PRIVMSG #communi :line " + QByteArray::number(written.count()) + QByteArray(padding, 'x');
+            segment += record;
+            written += record;
+        }
+        offsets += file.size();
+        index.write(MessageLog::indexEntry(segment.first().timestamp, file.size()));
+        file.write(MessageLog::encode(segment));
+    }
+}
+
+void tst_MessageLog::patch(qint64 offset, const QByteArray& bytes)
+{
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(offset));
+    QCOMPARE(file.write(bytes), qint64(bytes.size()));
+}
+
+Records tst_MessageLog::records(int from, int to) const
+{
+    return written.mid(from, to - from);
+}
+
+void tst_MessageLog::compare(const Records& actual, const Records& expected)
+{
+    QCOMPARE(actual.count(), expected.count());
+    for (int i = 0; i < actual.count(); ++i) {
+        QCOMPARE(actual.at(i).timestamp, expected.at(i).timestamp);
+        QCOMPARE(actual.at(i).type, expected.at(i).type);
+        QCOMPARE(actual.at(i).data, expected.at(i).data);
+    }
+}
+
+void tst_MessageLog::testRoundTrip()
+{
+    write(5);
+
+    MessageLog log(filePath);
+    QVERIFY(log.open());
+    compare(log.read(QDateTime(), QDateTime()), written);
+
+    const QDateTime to = QDateTime::fromMSecsSinceEpoch(written.at(7).timestamp);
+    compare(log.read(QDateTime(), to), records(0, 8));
+}
+
+void tst_MessageLog::testCorruptPayload()
+{
+    write(5);
+
+    // a flipped byte within the second segment fails its checksum
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QVERIFY(file.seek(offsets.at(1) + 16));
+    patch(offsets.at(1) + 16, QByteArray(1, ~file.read(1).at(0)));
+
+    MessageLog log(filePath);
+    compare(log.read(QDateTime(), QDateTime()), records(0, perSegment) + records(2 * perSegment, written.count()));
+}
+
+void tst_MessageLog::testCorruptSize()
+{
+    write(5);
+
+    // a size that runs past the end of the file, and one that runs short
+    QByteArray large;
+    QDataStream(&large, QIODevice::WriteOnly) << quint32(1024 * 1024);
+    patch(offsets.at(1) + sizeof(quint32), large);
+    QByteArray small;
+    QDataStream(&small, QIODevice::WriteOnly) << quint32(5);
+    patch(offsets.at(3) + sizeof(quint32), small);
+
+    MessageLog log(filePath);
+    compare(log.read(QDateTime(), QDateTime()), records(0, perSegment)
+                                                + records(2 * perSegment, 3 * perSegment)
+                                                + records(4 * perSegment, written.count()));
+}
+
+void tst_MessageLog::testSeek()
+{
+    write(10);
+
+    // the first segment claims a time after everything else, so a reader
+    // that did not go through the index would come across it first
+    MessageLog::Record record = written.first();
+    record.timestamp = clock.addDays(1).toMSecsSinceEpoch();
+    const QByteArray segment = MessageLog::encode(Records() << record << written.at(1) << written.at(2));
+    QCOMPARE(segment.size(), int(offsets.at(1) - offsets.at(0)));
+    patch(offsets.at(0), segment);
+
+    MessageLog log(filePath);
+    QVERIFY(log.open());
+
+    // from the start of a segment, and from within one
+    const QDateTime first = QDateTime::fromMSecsSinceEpoch(written.at(7 * perSegment).timestamp);
+    QVERIFY(log.seek(first));
+    MessageLog::Record next;
+    QVERIFY(log.read(&next));
+    QCOMPARE(next.timestamp, written.at(7 * perSegment).timestamp);
+
+    const QDateTime within = QDateTime::fromMSecsSinceEpoch(written.at(5 * perSegment + 1).timestamp);
+    compare(log.read(within, QDateTime()), records(5 * perSegment + 1, written.count()));
+}
+
+void tst_MessageLog::testLast()
+{
+    write(10);
+
+    MessageLog log(filePath);
+    compare(log.last(4, QDateTime()), records(written.count() - 4, written.count()));
+    compare(log.last(10, QDateTime::fromMSecsSinceEpoch(written.at(20).timestamp)), records(11, 21));
+    compare(log.last(100, QDateTime()), written);
+}
+
+void tst_MessageLog::testCompressed()
+{
+    // big enough records to spread the log over several frames
+    write(10, 200 * 1024);
+    QVERIFY(MessageLog::compress(filePath));
+
+    const QString archivePath = filePath + LogArchive::suffix();
+    QVERIFY(!QFile::exists(filePath));
+    QVERIFY(!QFile::exists(MessageLog::indexPath(filePath)));
+    QVERIFY(QFile::exists(archivePath));
+    QVERIFY(QFile::exists(MessageLog::indexPath(archivePath)));
+
+    MessageLog log(archivePath);
+    compare(log.read(QDateTime(), QDateTime()), written);
+
+    const QDateTime within = QDateTime::fromMSecsSinceEpoch(written.at(8 * perSegment + 2).timestamp);
+    compare(log.read(within, QDateTime()), records(8 * perSegment + 2, written.count()));
+
+    compare(log.last(5, QDateTime()), records(written.count() - 5, written.count()));
+}
+
+QTEST_MAIN(tst_MessageLog)
+
+#include "tst_messagelog.moc"
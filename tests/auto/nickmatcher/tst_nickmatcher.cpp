@@ -0,0 +1,184 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include <QRegularExpression>
+#include "nickmatcher.h"
+
+Q_DECLARE_METATYPE(QList<int>)
+
+static bool longerThan(const QString& one, const QString& another)
+{
+    return one.length() > another.length();
+}
+
+// the matches the way a regular expression finds them: a nick that starts
+// and ends on a word boundary, the longest one where several start alike
+static QList<int> search(const QStringList& names, const QString& text)
+{
+    QStringList sorted = names;
+    qSort(sorted.begin(), sorted.end(), longerThan);
+    QStringList escaped;
+    foreach (const QString& name, sorted)
+        escaped += QRegularExpression::escape(name);
+
+    const QString boundary = QStringLiteral("(?:(?<!\\w)|(?!\\w))");
+    QRegularExpression regexp(boundary + "(?:" + escaped.join("|") + ")" + boundary,
+                              QRegularExpression::UseUnicodePropertiesOption);
+
+    QList<int> found;
+    QRegularExpressionMatchIterator it = regexp.globalMatch(text);
+    while (it.hasNext()) {
+        QRegularExpressionMatch match = it.next();
+        found << match.capturedStart() << match.capturedLength();
+    }
+    return found;
+}
+
+static QList<int> match(const QStringList& names, const QString& text)
+{
+    NickMatcher matcher;
+    matcher.setNames(names);
+
+    QList<int> found;
+    foreach (const NickMatcher::Match& match, matcher.match(text))
+        found << match.position << match.length;
+    return found;
+}
+
+class tst_NickMatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testEmpty();
+    void testMatch_data();
+    void testMatch();
+    void testMarkup_data();
+    void testMarkup();
+    void testRandom();
+};
+
+void tst_NickMatcher::testEmpty()
+{
+    NickMatcher matcher;
+    QVERIFY(matcher.isEmpty());
+    QVERIFY(matcher.match("jpnurmi: hi").isEmpty());
+
+    matcher.setNames(QStringList() << "jpnurmi");
+    QVERIFY(!matcher.isEmpty());
+
+    matcher.setNames(QStringList());
+    QVERIFY(matcher.isEmpty());
+}
+
+void tst_NickMatcher::testMatch_data()
+{
+    QTest::addColumn<QStringList>("names");
+    QTest::addColumn<QString>("text");
+
+    const QStringList names = QStringList() << "jpnurmi" << "jpnurmi_" << "foo" << "foobar" << "bar"
+                                            << "[away]" << "a|b" << "x-" << "Tëst" << "_";
+
+    QTest::newRow("none") << names << "nothing to see here";
+    QTest::newRow("alone") << names << "jpnurmi";
+    QTest::newRow("address") << names << "jpnurmi: hi";
+    QTest::newRow("several") << names << "foo, bar and jpnurmi_ met jpnurmi";
+    QTest::newRow("longest") << names << "foobar is not foo bar";
+    QTest::newRow("within") << names << "xfoo foox barfoo foobarx";
+    QTest::newRow("underscore") << names << "jpnurmi__ _jpnurmi _ __";
+    QTest::newRow("brackets") << names << "[away][away] x[away]x";
+    QTest::newRow("pipe") << names << "a|b|a|b a|bc ca|b";
+    QTest::newRow("dash") << names << "x- x-x x--";
+    QTest::newRow("unicode") << names << "Tëst Tëstä äTëst";
+    QTest::newRow("case") << names << "FOO Foo foo";
+    QTest::newRow("digits") << names << "foo1 1foo foo";
+}
+
+// plain text links exactly what the regular expression finds
+void tst_NickMatcher::testMatch()
+{
+    QFETCH(QStringList, names);
+    QFETCH(QString, text);
+
+    QCOMPARE(match(names, text), search(names, text));
+}
+
+void tst_NickMatcher::testMarkup_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QList<int> >("matches");
+
+    QTest::newRow("tag") << "<b>foo</b>" << (QList<int>() << 3 << 3);
+    QTest::newRow("attribute") << "<span class='foo'>bar</span>" << (QList<int>() << 18 << 3);
+    QTest::newRow("link") << "<a href='nick:foo'>foo</a> foo" << (QList<int>() << 27 << 3);
+    QTest::newRow("entities") << "&lt;foo&gt;" << (QList<int>() << 4 << 3);
+    QTest::newRow("ampersand") << "foo & bar" << (QList<int>() << 0 << 3 << 6 << 3);
+    QTest::newRow("unclosed") << "foo <bar" << (QList<int>() << 0 << 3 << 5 << 3);
+}
+
+// tags, entities and existing links are skipped
+void tst_NickMatcher::testMarkup()
+{
+    QFETCH(QString, text);
+    QFETCH(QList<int>, matches);
+
+    QCOMPARE(match(QStringList() << "foo" << "bar" << "lt" << "gt" << "span" << "nick", text), matches);
+}
+
+// any mix of nicks, prefixes of nicks and punctuation
+void tst_NickMatcher::testRandom()
+{
+    qsrand(2016);
+
+    QStringList names;
+    for (int i = 0; i < 200; ++i) {
+        QString name;
+        const int length = 1 + qrand() % 8;
+        for (int j = 0; j < length; ++j)
+            name += QLatin1Char("abcab_-|[]0"[qrand() % 11]);
+        names += name;
+    }
+    names.removeDuplicates();
+
+    const QString separators = QStringLiteral(" ,.:!?-_|");
+    for (int i = 0; i < 500; ++i) {
+        QString text;
+        const int words = 1 + qrand() % 20;
+        for (int j = 0; j < words; ++j) {
+            const QString name = names.at(qrand() % names.count());
+            text += qrand() % 4 ? name : name.left(qrand() % (name.length() + 1));
+            text += separators.at(qrand() % separators.length());
+        }
+        QCOMPARE(match(names, text), search(names, text));
+    }
+}
+
+QTEST_MAIN(tst_NickMatcher)
+
+#include "tst_nickmatcher.moc"
@@ -0,0 +1,250 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include <IrcBufferModel>
+#include <IrcConnection>
+#include <IrcBuffer>
+#include "textdocument.h"
+#include "messagedata.h"
+
+// the counts the way they used to be found, by looking at every line
+static void scan(const QList<MessageData>& lines, const QDateTime& seen, const QSet<QString>& highlighted, int* unread, int* highlights)
+{
+    *unread = 0;
+    *highlights = 0;
+    foreach (const MessageData& line, lines) {
+        if ((line.type() == IrcMessage::Private || line.type() == IrcMessage::Notice) && line.timestamp() > seen) {
+            ++*unread;
+            if (highlighted.contains(line.format()))
+                ++*highlights;
+        }
+    }
+}
+
+class tst_TextDocument : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testAppend();
+    void testLatestMessageSeen();
+    void testEviction();
+    void testRemoveHighlight();
+    void testLoaded();
+    void testSearchAfterReset();
+    void testFindOlder();
+
+private:
+    void append(int count);
+    void append(IrcMessage::Type type, bool highlight);
+    void verifyCounts();
+
+    int counter;
+    QDateTime clock;
+    QSet<QString> highlighted;
+    IrcConnection* connection;
+    TextDocument* document;
+};
+
+void tst_TextDocument::init()
+{
+    counter = 0;
+    clock = QDateTime(QDate(2016, 1, 1), QTime(23, 0));
+    highlighted.clear();
+
+    connection = new IrcConnection(this);
+    IrcBufferModel* model = new IrcBufferModel(connection);
+    document = new TextDocument(model->add("#communi"));
+    document->setLatestMessageSeen(clock);
+}
+
+void tst_TextDocument::cleanup()
+{
+    delete connection;
+}
+
+void tst_TextDocument::append(IrcMessage::Type type, bool highlight)
+{
+    clock = clock.addSecs(30);
+
+    MessageSnapshot snapshot;
+    snapshot.type = type;
+    snapshot.nick = QStringLiteral("nick");
+    snapshot.timestamp = clock;
+
+    MessageData data;
+    data.initFrom(snapshot);
+    data.setFormat(QString("line %1").arg(++counter));
+    document->append(data);
+
+    if (highlight) {
+        highlighted.insert(data.format());
+        document->addHighlight();
+    }
+}
+
+void tst_TextDocument::append(int count)
+{
+    // crosses midnight, so date changes are in the mix too
+    static const IrcMessage::Type types[] = { IrcMessage::Private, IrcMessage::Notice, IrcMessage::Join, IrcMessage::Private, IrcMessage::Part };
+    for (int i = 0; i < count; ++i) {
+        const IrcMessage::Type type = types[counter % 5];
+        append(type, type == IrcMessage::Private && counter % 7 == 0);
+        verifyCounts();
+    }
+}
+
+void tst_TextDocument::verifyCounts()
+{
+    int unread = 0;
+    int highlights = 0;
+    scan(document->lines(), document->latestMessageSeen(), highlighted, &unread, &highlights);
+    QCOMPARE(document->unreadMessages(), unread);
+    QCOMPARE(document->unreadHighlights(), highlights);
+}
+
+void tst_TextDocument::testAppend()
+{
+    append(300);
+    QVERIFY(document->unreadMessages() > 0);
+    QVERIFY(document->unreadHighlights() > 0);
+}
+
+void tst_TextDocument::testLatestMessageSeen()
+{
+    append(300);
+
+    const QList<MessageData> lines = document->lines();
+    for (int i = 0; i < lines.count(); i += 37) {
+        if (lines.at(i).timestamp().isValid()) {
+            document->setLatestMessageSeen(lines.at(i).timestamp());
+            verifyCounts();
+        }
+    }
+
+    document->setLatestMessageSeen(document->latestMessageReceived());
+    QCOMPARE(document->unreadMessages(), 0);
+    QCOMPARE(document->unreadHighlights(), 0);
+
+    document->setLatestMessageSeen(QDateTime(QDate(2016, 1, 1), QTime(23, 0)));
+    verifyCounts();
+}
+
+void tst_TextDocument::testEviction()
+{
+    document->setMaximumLineCount(50);
+    append(300);
+    QVERIFY(document->lines().count() <= 50);
+
+    document->setMaximumLineCount(20);
+    verifyCounts();
+}
+
+void tst_TextDocument::testRemoveHighlight()
+{
+    append(100);
+
+    const QList<MessageData> lines = document->lines();
+    for (int i = lines.count() - 1; i >= 0; --i) {
+        if (highlighted.remove(lines.at(i).format())) {
+            document->removeHighlight(i);
+            verifyCounts();
+        }
+    }
+    QCOMPARE(document->unreadHighlights(), 0);
+}
+
+void tst_TextDocument::testLoaded()
+{
+    append(100);
+
+    // laid out with a small window, so most lines are held as plain data
+    document->setVisibleLines(5);
+    document->setVisible(true);
+    document->setVisible(false);
+    QCOMPARE(document->unreadMessages(), 0);
+
+    document->setLatestMessageSeen(QDateTime(QDate(2016, 1, 1), QTime(23, 30)));
+    verifyCounts();
+
+    document->setMaximumLineCount(150);
+    append(200);
+    document->setVisible(true);
+    document->setLatestMessageSeen(QDateTime(QDate(2016, 1, 2), QTime(0, 30)));
+    verifyCounts();
+}
+
+void tst_TextDocument::testSearchAfterReset()
+{
+    document->setVisible(true);
+    append(20);
+    QCOMPARE(document->search(QStringLiteral("line 7")).count(), 1);
+
+    // the way a browser clears it
+    document->clear();
+    document->reset();
+    QVERIFY(document->search(QStringLiteral("line 7")).isEmpty());
+
+    counter = 100;
+    append(20);
+    QVERIFY(document->search(QStringLiteral("line 7")).isEmpty());
+    const QList<int> found = document->search(QStringLiteral("line 107"));
+    QCOMPARE(found.count(), 1);
+    QVERIFY(document->findBlockByNumber(found.first()).text().contains(QStringLiteral("line 107")));
+}
+
+void tst_TextDocument::testFindOlder()
+{
+    // laid out with a small window, so most lines are held as plain data
+    document->setVisibleLines(5);
+    document->setVisible(true);
+    append(300);
+
+    // searching leaves the held lines alone
+    const int blocks = document->blockCount();
+    QVERIFY(document->search(QStringLiteral("line 151")).isEmpty());
+    QCOMPARE(document->blockCount(), blocks);
+
+    // the match is laid out along with the lines after it, and no further
+    QVERIFY(document->findOlder(QStringLiteral("line 151")));
+    const QList<int> found = document->search(QStringLiteral("line 151"));
+    QCOMPARE(found, QList<int>() << 0);
+    QVERIFY(document->findBlockByNumber(0).text().contains(QStringLiteral("line 151")));
+    QVERIFY(document->search(QStringLiteral("line 146")).isEmpty());
+    verifyCounts();
+
+    QVERIFY(!document->findOlder(QStringLiteral("no such line")));
+}
+
+QTEST_MAIN(tst_TextDocument)
+
+#include "tst_textdocument.moc"
@@ -0,0 +1,10 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = subdirs
+SUBDIRS += formatcache
+SUBDIRS += messagedata
+SUBDIRS += nicklookup
+SUBDIRS += nickmatcher
+SUBDIRS += textdocument
@@ -0,0 +1,129 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include "messageformatter.h"
+#include "formatcache.h"
+#include "nickmatcher.h"
+#include "messagedata.h"
+
+// a CI channel: bots repeating the same few lines with the odd build
+// number, commit or link in between, and people chatting now and then
+static QList<MessageSnapshot> trace(int count)
+{
+    static const char* const repeated[] = {
+        "The build passed.",
+        "The build was fixed.",
+        "The build is still failing.",
+        "Change view : https://github.com/communi/communi-desktop/compare/master",
+        "Build details : https://travis-ci.org/communi/communi-desktop/builds",
+        "\x02[communi-desktop]\x0f \x03" "03master\x0f is green again",
+        "\x03" "04FAILURE\x0f tests/auto/textdocument",
+        0
+    };
+
+    QDateTime timestamp(QDate(2016, 1, 1), QTime(12, 0));
+    QList<MessageSnapshot> messages;
+    qsrand(count);
+    for (int i = 0; i < count; ++i) {
+        MessageSnapshot snapshot;
+        snapshot.type = IrcMessage::Private;
+        snapshot.target = "#communi-ci";
+        snapshot.timestamp = timestamp.addSecs(i);
+
+        const int kind = qrand() % 10;
+        if (kind < 7) {
+            snapshot.nick = "travis-ci";
+            snapshot.content = QString::fromUtf8(repeated[qrand() % 7]);
+        } else if (kind < 9) {
+            snapshot.nick = "travis-ci";
+            snapshot.content = QString("communi/communi-desktop#%1 (master - %2 : jpnurmi): The build passed.")
+                               .arg(1000 + i).arg(qrand(), 7, 16, QLatin1Char('0'));
+        } else {
+            snapshot.nick = QString("dev%1").arg(qrand() % 5);
+            snapshot.content = QString("travis-ci: did dev%1 break the build again? see line %2").arg(qrand() % 5).arg(i);
+        }
+        messages += snapshot;
+    }
+    return messages;
+}
+
+class tst_FormatCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanupTestCase();
+
+    void replay_data();
+    void replay();
+};
+
+void tst_FormatCache::cleanupTestCase()
+{
+    FormatCache::instance()->setCapacity(2000);
+    FormatCache::instance()->clear();
+}
+
+void tst_FormatCache::replay_data()
+{
+    QTest::addColumn<int>("capacity");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("off 2000") << 0 << 2000;
+    QTest::newRow("on 2000") << 2000 << 2000;
+    QTest::newRow("off 20000") << 0 << 20000;
+    QTest::newRow("on 20000") << 2000 << 20000;
+}
+
+// formats the trace the way the workers do, with the cache off and on
+void tst_FormatCache::replay()
+{
+    QFETCH(int, capacity);
+    QFETCH(int, count);
+
+    const QList<MessageSnapshot> messages = trace(count);
+    NickMatcher nicks;
+    nicks.setNames(QStringList() << "travis-ci" << "dev0" << "dev1" << "dev2" << "dev3" << "dev4" << "jpnurmi");
+
+    FormatCache* cache = FormatCache::instance();
+    cache->setCapacity(capacity);
+
+    QBENCHMARK {
+        cache->clear();
+        cache->resetStats();
+        foreach (const MessageSnapshot& message, messages)
+            MessageFormatter::formatSnapshot(message, nicks, 1);
+    }
+
+    qDebug("%d hits, %d misses", cache->hits(), cache->misses());
+}
+
+QTEST_MAIN(tst_FormatCache)
+
+#include "tst_bench_formatcache.moc"
@@ -0,0 +1,7 @@
+######################################################################
+# Communi
+######################################################################
+
+include(../benchmarks.pri)
+
+SOURCES += $$PWD/tst_bench_messagedata.cpp
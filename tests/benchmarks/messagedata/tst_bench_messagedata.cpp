@@ -0,0 +1,167 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include <IrcConnection>
+#include <IrcMessage>
+#include "messagedata.h"
+
+#ifdef Q_OS_LINUX
+#include <malloc.h>
+#endif
+
+// the per-line record as it was before lines shared their data:
+// every line carried its own nick, raw message and QDateTime
+struct PlainData
+{
+    bool own;
+    bool error;
+    bool reply;
+    QString nick;
+    QString format;
+    QByteArray data;
+    QDateTime timestamp;
+    IrcMessage::Type type;
+    QList<PlainData> events;
+};
+
+class tst_MessageData : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void retained_data();
+    void retained();
+
+private:
+    static qint64 allocated();
+    static QList<QByteArray> messages(int count);
+
+    IrcConnection* connection;
+};
+
+void tst_MessageData::initTestCase()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("heap usage is only measured with glibc");
+#endif
+    connection = new IrcConnection(this);
+    connection->setNickName("communi");
+}
+
+void tst_MessageData::cleanupTestCase()
+{
+    delete connection;
+}
+
+qint64 tst_MessageData::allocated()
+{
+#ifdef Q_OS_LINUX
+    return mallinfo().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// a busy channel: a few dozen regulars talking with server-time stamps
+QList<QByteArray> tst_MessageData::messages(int count)
+{
+    QDateTime timestamp(QDate(2016, 1, 1), QTime(12, 0), Qt::UTC);
+    QList<QByteArray> messages;
+    for (int i = 0; i < count; ++i) {
+        QString time = timestamp.addSecs(i).toString("yyyy-MM-dd'T'hh:mm:ss.zzz'Z'");
+        QString nick = QString("nick%1").arg(i % 40);
+        QByteArray data = QString("@time=%1 :%2!~%2@host%3.example.org PRIVMSG #communi :catching up on line %4")
+                          .arg(time, nick).arg(i % 40).arg(i).toUtf8();
+        messages += data;
+    }
+    return messages;
+}
+
+void tst_MessageData::retained_data()
+{
+    QTest::addColumn<bool>("plain");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("before 1000") << true << 1000;
+    QTest::newRow("before 10000") << true << 10000;
+    QTest::newRow("after 1000") << false << 1000;
+    QTest::newRow("after 10000") << false << 10000;
+}
+
+// bytes kept alive per line once its message is gone
+void tst_MessageData::retained()
+{
+    QFETCH(bool, plain);
+    QFETCH(int, count);
+
+    const QList<QByteArray> input = messages(count);
+    QList<PlainData> before;
+    QList<MessageData> after;
+    before.reserve(count);
+    after.reserve(count);
+
+    const qint64 start = allocated();
+    foreach (const QByteArray& data, input) {
+        // each message is read off its own buffer and goes away as soon as its line is made
+        IrcMessage* message = IrcMessage::fromData(QByteArray(data.constData(), data.size()), connection);
+        const QString body = static_cast<IrcPrivateMessage*>(message)->content().toHtmlEscaped();
+        const QString format = QString("&lt;%1&gt; %2").arg(message->nick(), body);
+        if (plain) {
+            PlainData line;
+            line.own = message->isOwn();
+            line.error = false;
+            line.reply = false;
+            line.nick = message->nick();
+            line.format = format;
+            line.data = message->toData();
+            line.timestamp = message->timeStamp();
+            line.type = message->type();
+            before += line;
+        } else {
+            MessageData line;
+            line.initFrom(MessageSnapshot(message));
+            line.setFormat(format);
+            line.shareContent(body);
+            after += line;
+        }
+        delete message;
+    }
+
+    // the nicks interned by earlier rows stay in the pool, which is what
+    // a long running session looks like too
+    QCOMPARE(before.count() + after.count(), count);
+    QTest::setBenchmarkResult(qreal(allocated() - start) / count, QTest::BytesAllocated);
+}
+
+QTEST_MAIN(tst_MessageData)
+
+#include "tst_bench_messagedata.moc"
@@ -0,0 +1,142 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include <QStringListModel>
+#include <IrcUser>
+#include "nicklookup.h"
+
+static const int userCount = 20000;
+
+class tst_NickLookup : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void insert();
+    void find();
+    void containing_data();
+    void containing();
+    void match_data();
+    void match();
+
+private:
+    QStringList names;
+    QList<IrcUser*> users;
+};
+
+// a big channel: nicks with common stems, digits and the usual punctuation
+void tst_NickLookup::initTestCase()
+{
+    static const char* const stems[] = { "alex", "anna", "bot", "chris", "dev", "guest", "jpnurmi", "kim", "max", "user", 0 };
+    static const char* const suffixes[] = { "", "_", "|away", "[m]", "-web", 0 };
+
+    qsrand(userCount);
+    for (int i = 0; i < userCount; ++i) {
+        names += QString("%1%2%3").arg(stems[qrand() % 10]).arg(i).arg(suffixes[qrand() % 5]);
+        users += new IrcUser(this);
+    }
+}
+
+void tst_NickLookup::cleanupTestCase()
+{
+    qDeleteAll(users);
+    users.clear();
+}
+
+void tst_NickLookup::insert()
+{
+    QBENCHMARK {
+        NickLookup lookup;
+        for (int i = 0; i < userCount; ++i)
+            lookup.insert(users.at(i), names.at(i));
+    }
+}
+
+void tst_NickLookup::find()
+{
+    NickLookup lookup;
+    for (int i = 0; i < userCount; ++i)
+        lookup.insert(users.at(i), names.at(i));
+
+    QBENCHMARK {
+        for (int i = 0; i < userCount; i += 100)
+            QVERIFY(lookup.find(names.at(i).toUpper()) == users.at(i));
+    }
+}
+
+void tst_NickLookup::containing_data()
+{
+    QTest::addColumn<QString>("text");
+
+    // typed one character at a time, then a miss
+    QTest::newRow("j") << "j";
+    QTest::newRow("jp") << "jp";
+    QTest::newRow("jpn") << "jpn";
+    QTest::newRow("jpnurmi1") << "jpnurmi1";
+    QTest::newRow("jpnurmi12") << "jpnurmi12";
+    QTest::newRow("away") << "away";
+    QTest::newRow("none") << "nobody";
+}
+
+// the nick index lookup ListFinder uses now, by prefix below three characters
+void tst_NickLookup::containing()
+{
+    QFETCH(QString, text);
+
+    NickLookup lookup;
+    for (int i = 0; i < userCount; ++i)
+        lookup.insert(users.at(i), names.at(i));
+
+    QBENCHMARK {
+        lookup.containing(text);
+    }
+}
+
+void tst_NickLookup::match_data()
+{
+    containing_data();
+}
+
+// the model match ListFinder used before, a QVariant per row
+void tst_NickLookup::match()
+{
+    QFETCH(QString, text);
+
+    QStringListModel model(names);
+    QBENCHMARK {
+        model.match(model.index(0, 0), Qt::DisplayRole, text, -1, Qt::MatchContains);
+    }
+}
+
+QTEST_MAIN(tst_NickLookup)
+
+#include "tst_bench_nicklookup.moc"
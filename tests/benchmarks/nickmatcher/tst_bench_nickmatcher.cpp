@@ -0,0 +1,196 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include <QTextBoundaryFinder>
+#include "nickmatcher.h"
+
+// how nicks used to be linked: every nick that shares the first character
+// is tried at each word boundary
+static QString linkBefore(const QMultiHash<QChar, QString>& names, QString msg)
+{
+    QTextBoundaryFinder finder = QTextBoundaryFinder(QTextBoundaryFinder::Word, msg);
+    int pos = 0;
+    while (pos < msg.length()) {
+        const QChar c = msg.at(pos);
+        if (!c.isSpace()) {
+            if (c == '<' && msg.midRef(pos, 3) == "<a ") {
+                const int end = msg.indexOf("</a>", pos + 3);
+                if (end != -1) {
+                    pos = end + 4;
+                    continue;
+                }
+            }
+            finder.setPosition(pos);
+            if (finder.isAtBoundary()) {
+                QMultiHash<QChar, QString>::const_iterator it = names.find(c);
+                while (it != names.constEnd() && it.key() == c) {
+                    const QString& user = it.value();
+                    if (msg.midRef(pos, user.length()) == user) {
+                        finder.setPosition(pos + user.length());
+                        if (finder.isAtBoundary()) {
+                            const QString formatted = QString("<a href='nick:%1'>%1</a>").arg(user);
+                            msg.replace(pos, user.length(), formatted);
+                            pos += formatted.length();
+                            finder = QTextBoundaryFinder(QTextBoundaryFinder::Word, msg);
+                        }
+                    }
+                    ++it;
+                }
+            }
+        }
+        ++pos;
+    }
+    return msg;
+}
+
+// and how they are linked now, in one scan and one more pass
+static QString linkAfter(const NickMatcher& matcher, const QString& msg)
+{
+    QString linked;
+    int pos = 0;
+    foreach (const NickMatcher::Match& match, matcher.match(msg)) {
+        const QString user = msg.mid(match.position, match.length);
+        linked += msg.midRef(pos, match.position - pos);
+        linked += QString("<a href='nick:%1'>%1</a>").arg(user);
+        pos = match.position + match.length;
+    }
+    linked += msg.midRef(pos);
+    return linked;
+}
+
+class tst_NickMatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void setNames_data();
+    void setNames();
+    void before_data();
+    void before();
+    void after_data();
+    void after();
+
+private:
+    static QStringList names(int count);
+    static QStringList messages(const QStringList& names);
+};
+
+QStringList tst_NickMatcher::names(int count)
+{
+    qsrand(count);
+    QStringList names;
+    for (int i = 0; i < count; ++i) {
+        QString name;
+        const int length = 3 + qrand() % 10;
+        for (int j = 0; j < length; ++j)
+            name += QLatin1Char("abcdefghijklmnopqrstuvwxyz_|[]"[qrand() % 30]);
+        names += name;
+    }
+    names.removeDuplicates();
+    return names;
+}
+
+// a handful of nicks addressed in each line, the rest is chatter
+QStringList tst_NickMatcher::messages(const QStringList& names)
+{
+    QStringList messages;
+    for (int i = 0; i < 100; ++i) {
+        messages += QString("%1: did you see what %2 said about the build? "
+                            "<a href='http://communi.github.io'>http://communi.github.io</a> "
+                            "has the logs, &lt;%3&gt; thinks it is fixed")
+                    .arg(names.at(qrand() % names.count()), names.at(qrand() % names.count()), names.at(qrand() % names.count()));
+    }
+    return messages;
+}
+
+void tst_NickMatcher::setNames_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+}
+
+// compiling the automaton whenever the nick list changes
+void tst_NickMatcher::setNames()
+{
+    QFETCH(int, count);
+    const QStringList list = names(count);
+
+    QBENCHMARK {
+        NickMatcher matcher;
+        matcher.setNames(list);
+    }
+}
+
+void tst_NickMatcher::before_data()
+{
+    setNames_data();
+}
+
+void tst_NickMatcher::before()
+{
+    QFETCH(int, count);
+    const QStringList list = names(count);
+    const QStringList lines = messages(list);
+
+    QMultiHash<QChar, QString> hash;
+    foreach (const QString& name, list)
+        hash.insert(name.at(0), name);
+
+    QBENCHMARK {
+        foreach (const QString& line, lines)
+            linkBefore(hash, line);
+    }
+}
+
+void tst_NickMatcher::after_data()
+{
+    setNames_data();
+}
+
+void tst_NickMatcher::after()
+{
+    QFETCH(int, count);
+    const QStringList list = names(count);
+    const QStringList lines = messages(list);
+
+    NickMatcher matcher;
+    matcher.setNames(list);
+
+    QBENCHMARK {
+        foreach (const QString& line, lines)
+            linkAfter(matcher, line);
+    }
+}
+
+QTEST_MAIN(tst_NickMatcher)
+
+#include "tst_bench_nickmatcher.moc"
@@ -0,0 +1,135 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <QtTest/QtTest>
+#include <QAbstractTextDocumentLayout>
+#include <IrcBufferModel>
+#include <IrcConnection>
+#include <IrcBuffer>
+#include "textdocument.h"
+#include "messagedata.h"
+
+class tst_TextDocument : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void insert_data();
+    void insert();
+    void flush_data();
+    void flush();
+
+private:
+    QList<MessageData> lines(int count) const;
+
+    IrcConnection* connection;
+    IrcBuffer* buffer;
+};
+
+void tst_TextDocument::initTestCase()
+{
+    connection = new IrcConnection(this);
+    IrcBufferModel* model = new IrcBufferModel(connection);
+    buffer = model->add("#communi");
+}
+
+void tst_TextDocument::cleanupTestCase()
+{
+    delete connection;
+}
+
+QList<MessageData> tst_TextDocument::lines(int count) const
+{
+    QDateTime timestamp(QDate(2016, 1, 1), QTime(12, 0));
+    QList<MessageData> lines;
+    for (int i = 0; i < count; ++i) {
+        MessageSnapshot snapshot;
+        snapshot.type = IrcMessage::Private;
+        snapshot.nick = QString("nick%1").arg(i % 50);
+        snapshot.timestamp = timestamp.addSecs(i);
+
+        MessageData data;
+        data.initFrom(snapshot);
+        data.setFormat(QString("&lt;<a href='nick:%1' style='color:#0000ff'>%1</a>&gt; "
+                               "catching up on line %2, see <a href='http://communi.github.io'>http://communi.github.io</a>").arg(snapshot.nick).arg(i));
+        lines += data;
+    }
+    return lines;
+}
+
+void tst_TextDocument::insert_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("800") << 800;
+}
+
+// the per-message path: one insert() per line
+void tst_TextDocument::insert()
+{
+    QFETCH(int, count);
+    const QList<MessageData> data = lines(count);
+
+    QBENCHMARK {
+        TextDocument document(buffer);
+        QTextCursor cursor(&document);
+        cursor.beginEditBlock();
+        foreach (const MessageData& line, data)
+            document.insert(cursor, line);
+        cursor.endEditBlock();
+        document.documentLayout()->documentSize();
+    }
+}
+
+void tst_TextDocument::flush_data()
+{
+    insert_data();
+}
+
+// the batched path: a hidden document queues the lines and lays them out in one go when shown
+void tst_TextDocument::flush()
+{
+    QFETCH(int, count);
+    const QList<MessageData> data = lines(count);
+
+    QBENCHMARK {
+        TextDocument document(buffer);
+        foreach (const MessageData& line, data)
+            document.append(line);
+        document.setVisible(true);
+        document.documentLayout()->documentSize();
+    }
+}
+
+QTEST_MAIN(tst_TextDocument)
+
+#include "tst_bench_textdocument.moc"
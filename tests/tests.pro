@@ -0,0 +1,6 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = subdirs
+SUBDIRS += auto benchmarks